@@ -0,0 +1,267 @@
+/*
+
+Microbenchmarks of the bit-banged drivers, run against a counting GPIO stub (gpio_counter.c).
+
+For every driver function, this reports how many pin writes and reads one call makes, how much
+delay it asks for, and how long it takes on the CPU with the pins and delays taken out. The results
+are printed as a table and written as JSON, so driver changes can be compared run to run:
+
+    gcc -O2 -Isim -Isrc bench/bench.c bench/gpio_counter.c bench/bench_matrix.c bench/bench_bar.c \
+        bench/bench_joystick.c bench/bench_stations.c src/clock.c src/gpio.c src/animation.c src/joystick_decoder.c \
+        src/frame_export.c src/station.c src/stats.c src/trace.c \
+        -o drivers-bench -lpthread -lm -lrt
+    ./drivers-bench [results.json]
+
+The derived rates assume pin accesses are free, so they are upper bounds of what the drivers allow.
+The exception is the matrix_chain benchmarks, which scan an intensity frame across 1, 2, 4 and 8
+daisy-chained panels. Pins are free in that benchmark, so it would not show how the burst per
+latch grows with the chain. Instead they drive a fake register block (a temporary file) through
+gpio.c's fast path, where every edge costs a store and a trace entry, like gpio_edge. Their refresh
+rate then falls with the panel count, the way it does on the hardware, where each edge costs a
+register write.
+
+Last, a sweep runs growing numbers of stations (see station.c) on a worker pool with one worker per
+core, at STATION_REFRESH_HZ. Delays are real during the sweep, so ADC transfers take as long as on
+the hardware, and the stations drive the fake register block, so their pin edges cost time too.
+The most stations whose scans overran in fewer than STATION_MAX_OVERRUN of their row slots is
+reported as the machine's station capacity.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "clock.h"
+#include "gpio.h"
+
+// How long each benchmark runs for, at least, in nanoseconds.
+#define BENCH_MIN_NS 200000000ULL
+
+// How many calls are timed between clock reads.
+#define BENCH_BATCH 256
+
+// The refresh rate the station sweep drives its stations at, and how long each step runs for.
+#define STATION_REFRESH_HZ 500
+#define STATION_RUN_MS 500
+
+// The share of row slots that may overrun before the stations count as not keeping up.
+#define STATION_MAX_OVERRUN 0.01
+
+// The station counts the sweep tries, in increasing order.
+static const int STATION_COUNTS[] = {1, 2, 4, 8, 16, 24, 32, 48, 64};
+
+// The fake register block, or NULL if it could not be mapped.
+static volatile uint32_t *fakeRegs = NULL;
+
+#define STATION_COUNT_STEPS (int)(sizeof(STATION_COUNTS) / sizeof(int))
+
+typedef struct
+{
+    const char *name;
+    void (*run)();
+    // Whether the benchmark drives the fake register block instead of the counting stub.
+    int fakeGpio;
+} Benchmark;
+
+typedef struct
+{
+    unsigned long iterations;
+    double nsPerOp;
+    double writesPerOp;
+    double readsPerOp;
+    double delayNsPerOp;
+    double maxRateHz;
+} BenchResult;
+
+static const Benchmark BENCHMARKS[] = {
+    {"matrix_push_byte", benchMatrixPushByte, 0},
+    {"matrix_frame", benchMatrixFrame, 0},
+    {"matrix_intensity_frame", benchMatrixIntensityFrame, 0},
+    {"bar_push_word", benchBarPushWord, 0},
+    {"bar_frame", benchBarFrame, 0},
+    {"joystick_read_channel", benchJoystickReadChannel, 0},
+    {"gpio_edge", benchGpioEdge, 1},
+    {"matrix_chain_1", benchMatrixChain1, 1},
+    {"matrix_chain_2", benchMatrixChain2, 1},
+    {"matrix_chain_4", benchMatrixChain4, 1},
+    {"matrix_chain_8", benchMatrixChain8, 1},
+};
+
+#define BENCHMARK_COUNT (int)(sizeof(BENCHMARKS) / sizeof(Benchmark))
+
+static void mapFakeGpio();
+static void measure(const Benchmark *benchmark, BenchResult *result);
+static int sweepStations(BenchStationRun *runs);
+static int writeJson(const char *path, const BenchResult *results, const BenchStationRun *runs, int runCount);
+static double maxRate(const BenchResult *results, const char *name);
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "bench.json";
+    BenchResult results[BENCHMARK_COUNT];
+
+    mapFakeGpio();
+    printf("%-24s %12s %10s %10s %14s %14s\n", "benchmark", "ns/op", "writes/op", "reads/op", "delay ns/op", "max rate Hz");
+
+    for (int i = 0; i < BENCHMARK_COUNT; i++)
+    {
+        measure(&BENCHMARKS[i], &results[i]);
+        printf("%-24s %12.1f %10.1f %10.1f %14.0f %14.0f\n", BENCHMARKS[i].name, results[i].nsPerOp,
+               results[i].writesPerOp, results[i].readsPerOp, results[i].delayNsPerOp, results[i].maxRateHz);
+    }
+
+    BenchStationRun runs[STATION_COUNT_STEPS];
+    int runCount = sweepStations(runs);
+
+    if (writeJson(path, results, runs, runCount) == -1)
+        return 1;
+
+    printf("Results written to %s\n", path);
+    return 0;
+}
+
+// Maps a fake register block for the benchmarks that drive one, and leaves the fast path off until
+// they run. They fall back to the counting stub if it cannot be mapped.
+static void mapFakeGpio()
+{
+    char path[] = "/tmp/drivers-bench-gpio-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+    {
+        perror("Failed to create a fake register block");
+        return;
+    }
+
+    close(fd);
+    if (gpioFastInit(path) == 0)
+        fakeRegs = gpioRegs;
+    gpioRegs = NULL;
+    unlink(path);
+}
+
+// Runs a benchmark for at least BENCH_MIN_NS and fills in its per-call results.
+static void measure(const Benchmark *benchmark, BenchResult *result)
+{
+    gpioRegs = benchmark->fakeGpio ? fakeRegs : NULL;
+
+    // Warm up the caches and branch predictors first.
+    for (int i = 0; i < BENCH_BATCH; i++)
+        benchmark->run();
+
+    benchCounters = (BenchCounters){0};
+    unsigned int fakeWrites = gpioFakeWriteCount();
+    unsigned long iterations = 0;
+    uint64_t start = clockNowNs();
+    uint64_t elapsed = 0;
+
+    while (elapsed < BENCH_MIN_NS)
+    {
+        for (int i = 0; i < BENCH_BATCH; i++)
+            benchmark->run();
+
+        iterations += BENCH_BATCH;
+        elapsed = clockNowNs() - start;
+    }
+
+    // Writes to the fake register block are traced instead of counted by the stub.
+    if (gpioRegs)
+        benchCounters.writes += gpioFakeWriteCount() - fakeWrites;
+    gpioRegs = NULL;
+
+    result->iterations = iterations;
+    result->nsPerOp = (double)elapsed / iterations;
+    result->writesPerOp = (double)benchCounters.writes / iterations;
+    result->readsPerOp = (double)benchCounters.reads / iterations;
+    result->delayNsPerOp = (double)benchCounters.delayNs / iterations;
+    result->maxRateHz = 1e9 / (result->nsPerOp + result->delayNsPerOp);
+}
+
+// Runs the station counts in turn, stopping after the first that cannot keep up.
+// Returns how many runs were filled in.
+static int sweepStations(BenchStationRun *runs)
+{
+    printf("\n%-10s %12s %14s %12s\n", "stations", "fps/station", "samples/s", "overruns");
+    gpioRegs = fakeRegs;
+
+    int count = 0;
+    while (count < STATION_COUNT_STEPS)
+    {
+        BenchStationRun *run = &runs[count];
+        if (benchStations(STATION_COUNTS[count], STATION_REFRESH_HZ, STATION_RUN_MS, run) == -1)
+            break;
+
+        count++;
+        printf("%-10d %12.1f %14.1f %11.2f%%\n", run->stations, run->fpsPerStation, run->samplesPerStation,
+               run->overrunRate * 100);
+
+        if (run->overrunRate >= STATION_MAX_OVERRUN)
+            break;
+    }
+
+    gpioRegs = NULL;
+    return count;
+}
+
+// Writes the results as JSON. Returns 0 on success, or -1 if the file could not be written.
+static int writeJson(const char *path, const BenchResult *results, const BenchStationRun *runs, int runCount)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        perror("Failed to open results file");
+        return -1;
+    }
+
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < BENCHMARK_COUNT; i++)
+    {
+        fprintf(file,
+                "    {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.2f, \"gpio_writes_per_op\": %.2f, "
+                "\"gpio_reads_per_op\": %.2f, \"delay_ns_per_op\": %.0f, \"max_rate_hz\": %.1f}%s\n",
+                BENCHMARKS[i].name, results[i].iterations, results[i].nsPerOp, results[i].writesPerOp,
+                results[i].readsPerOp, results[i].delayNsPerOp, results[i].maxRateHz, i + 1 < BENCHMARK_COUNT ? "," : "");
+    }
+
+    fprintf(file, "  ],\n  \"stations\": [\n");
+    int capacity = 0;
+    for (int i = 0; i < runCount; i++)
+    {
+        fprintf(file, "    {\"stations\": %d, \"fps_per_station\": %.1f, \"samples_per_station\": %.1f, \"overrun_rate\": %.4f}%s\n",
+                runs[i].stations, runs[i].fpsPerStation, runs[i].samplesPerStation, runs[i].overrunRate,
+                i + 1 < runCount ? "," : "");
+
+        if (runs[i].overrunRate < STATION_MAX_OVERRUN)
+            capacity = runs[i].stations;
+    }
+
+    // The rates the drivers are scheduled at depend on these: a matrix refresh is one frame, and a
+    // joystick sample reads both channels.
+    fprintf(file, "  ],\n  \"derived\": {\n");
+    fprintf(file, "    \"matrix_max_refresh_hz\": %.1f,\n", maxRate(results, "matrix_frame"));
+    fprintf(file, "    \"matrix_max_intensity_refresh_hz\": %.1f,\n", maxRate(results, "matrix_intensity_frame"));
+    fprintf(file, "    \"bar_max_frame_hz\": %.1f,\n", maxRate(results, "bar_frame"));
+    fprintf(file, "    \"joystick_max_sample_hz\": %.1f,\n", maxRate(results, "joystick_read_channel") / 2);
+    fprintf(file, "    \"matrix_max_refresh_hz_by_panels\": {\"1\": %.1f, \"2\": %.1f, \"4\": %.1f, \"8\": %.1f},\n",
+            maxRate(results, "matrix_chain_1"), maxRate(results, "matrix_chain_2"),
+            maxRate(results, "matrix_chain_4"), maxRate(results, "matrix_chain_8"));
+    fprintf(file, "    \"max_stations_at_%d_hz\": %d\n", STATION_REFRESH_HZ, capacity);
+    fprintf(file, "  }\n}\n");
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Returns the highest rate the benchmark called `name` allows, or 0 if there is no such benchmark.
+static double maxRate(const BenchResult *results, const char *name)
+{
+    for (int i = 0; i < BENCHMARK_COUNT; i++)
+    {
+        if (strcmp(BENCHMARKS[i].name, name) == 0)
+            return results[i].maxRateHz;
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// What the counting GPIO stub has seen since the last reset, on the calling thread.
+typedef struct
+{
+    unsigned long writes;
+    unsigned long reads;
+    unsigned long long delayNs;
+} BenchCounters;
+
+// How a number of stations kept up with their refresh rate.
+typedef struct
+{
+    int stations;
+    double fpsPerStation;
+    double samplesPerStation;
+    double overrunRate;
+} BenchStationRun;
+
+extern __thread BenchCounters benchCounters;
+extern int benchRealDelays;
+
+void benchMatrixPushByte();
+void benchMatrixFrame();
+void benchMatrixIntensityFrame();
+void benchMatrixChain1();
+void benchMatrixChain2();
+void benchMatrixChain4();
+void benchMatrixChain8();
+void benchGpioEdge();
+void benchBarPushWord();
+void benchBarFrame();
+void benchJoystickReadChannel();
+int benchStations(int count, unsigned int refreshHz, unsigned int runMs, BenchStationRun *run);
+
+#endif
@@ -0,0 +1,15 @@
+// Benchmarks of the LED bar driver's static functions, compiled together with the driver.
+
+#include "../src/led_bar.c"
+#include "bench.h"
+
+void benchBarPushWord()
+{
+    pushWord(0xA5A5);
+}
+
+void benchBarFrame()
+{
+    static const unsigned short levels[LED_BAR_SIZE] = {65535, 65535, 32768, 4096, 0, 0, 0, 0, 0, 0};
+    sendFrame(levels);
+}
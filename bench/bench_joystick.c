@@ -0,0 +1,9 @@
+// Benchmarks of the joystick driver's static functions, compiled together with the driver.
+
+#include "../src/joystick.c"
+#include "bench.h"
+
+void benchJoystickReadChannel()
+{
+    readChannel(&JOYSTICK_PINS, X_CHANNEL);
+}
@@ -0,0 +1,72 @@
+// Benchmarks of the LED matrix driver's static functions, compiled together with the driver.
+
+#include "../src/led_matrix.c"
+#include "bench.h"
+
+void benchMatrixPushByte()
+{
+    pushByte(&LED_MATRIX_PINS, 0xA5);
+}
+
+// An on/off frame, which latches once per row.
+void benchMatrixFrame()
+{
+    static LedMatrixFramebuffer framebuffer;
+    if (!framebuffer.panels[0].planes[0][0])
+    {
+        for (int b = 0; b < LED_MATRIX_BITS; b++)
+            memcpy(framebuffer.panels[0].planes[b], ARROW_LEFT_BITS, SIZE);
+    }
+
+    workMatrixFrame(&framebuffer, 1, 0, 0);
+}
+
+// A frame with every plane different on the first `panels` chained panels, which latches once per
+// plane of every row.
+static void intensityFrame(int panels)
+{
+    static LedMatrixFramebuffer framebuffer;
+    for (int p = 0; p < panels; p++)
+    {
+        for (int b = 0; b < LED_MATRIX_BITS; b++)
+        {
+            for (int row = 0; row < SIZE; row++)
+                framebuffer.panels[p].planes[b][row] = 0x11 << b;
+        }
+    }
+
+    workMatrixFrame(&framebuffer, panels, 0, 0);
+}
+
+void benchMatrixIntensityFrame()
+{
+    intensityFrame(1);
+}
+
+void benchMatrixChain1()
+{
+    intensityFrame(1);
+}
+
+void benchMatrixChain2()
+{
+    intensityFrame(2);
+}
+
+void benchMatrixChain4()
+{
+    intensityFrame(4);
+}
+
+void benchMatrixChain8()
+{
+    intensityFrame(8);
+}
+
+// A single pin edge, which only costs anything on the fake register block.
+void benchGpioEdge()
+{
+    static int level = 0;
+    level = !level;
+    gpioDigitalWrite(LED_MATRIX_PINS.clk, level);
+}
@@ -0,0 +1,71 @@
+// Runs the station pool with real delays, on whatever GPIO the sweep set up, to find how many
+// stations the machine holds at a refresh rate.
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "clock.h"
+#include "station.h"
+
+static Station stations[STATION_MAX];
+
+// Drives `count` stations at `refreshHz` for `runMs`, every one showing a frame with every plane
+// different, and fills in how well their scans kept up.
+// Returns 0 on success, or -1 if the stations could not be started.
+int benchStations(int count, unsigned int refreshHz, unsigned int runMs, BenchStationRun *run)
+{
+    LedMatrixFramebuffer framebuffer;
+    ledMatrixFbClear(&framebuffer);
+    for (int b = 0; b < LED_MATRIX_BITS; b++)
+    {
+        for (int row = 0; row < SIZE; row++)
+            framebuffer.panels[0].planes[b][row] = 0x11 << b;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        // Give every station pins of its own, though they wrap around the 32 pins of the register block.
+        StationConfig config = {
+            .matrix = {.latch = i * 7, .clk = i * 7 + 1, .data = i * 7 + 2},
+            .panels = 1,
+            .joystick = {.data = i * 7 + 3, .clk = i * 7 + 4, .cs = i * 7 + 5, .button = i * 7 + 6},
+        };
+
+        if (stationInit(&stations[i], &config) == -1)
+            return -1;
+
+        stationPublish(&stations[i], &framebuffer);
+    }
+
+    benchRealDelays = 1;
+    if (stationPoolStart(stations, count, 0, refreshHz) == -1)
+    {
+        benchRealDelays = 0;
+        return -1;
+    }
+
+    uint64_t start = clockNowNs();
+    clockSleepUntilNs(start + runMs * 1000000ULL);
+    stationPoolStop();
+    uint64_t elapsed = clockNowNs() - start;
+    benchRealDelays = 0;
+
+    unsigned long frames = 0;
+    unsigned long overruns = 0;
+    unsigned long samples = 0;
+    for (int i = 0; i < count; i++)
+    {
+        StationStats stats;
+        stationGetStats(&stations[i], &stats);
+        frames += stats.frames;
+        overruns += stats.overruns;
+        samples += stats.samples;
+        close(stationEventFd(&stations[i]));
+    }
+
+    run->stations = count;
+    run->fpsPerStation = frames * 1e9 / elapsed / count;
+    run->samplesPerStation = samples * 1e9 / elapsed / count;
+    run->overrunRate = frames ? (double)overruns / (frames * SIZE) : 1;
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+
+A wiringPi stand-in for the benchmarks, which counts pin accesses and requested delays instead of
+touching pins or sleeping. The time a driver function takes against it is its pure CPU overhead.
+
+The station sweep sets `benchRealDelays`, so delays take their real time and the stations' ADC
+transfers keep their workers as busy as on the hardware. Every thread counts into counters of its
+own, so the pool's workers never race the benchmarks, which read the main thread's.
+
+*/
+
+#include "bench.h"
+#include "clock.h"
+#include "softTone.h"
+#include "wiringPi.h"
+#include "wiringShift.h"
+
+// Real delays shorter than this spin, like wiringPi's.
+#define BENCH_SPIN_NS 100000
+
+__thread BenchCounters benchCounters;
+int benchRealDelays = 0;
+
+int wiringPiSetup(void)
+{
+    return 0;
+}
+
+void pinMode(int pin, int mode)
+{
+}
+
+void digitalWrite(int pin, int value)
+{
+    benchCounters.writes++;
+}
+
+int digitalRead(int pin)
+{
+    benchCounters.reads++;
+    return pin & 1;
+}
+
+// wiringPi's shiftOut writes the data pin and pulses the clock for each bit.
+void shiftOut(uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val)
+{
+    benchCounters.writes += 8 * 3;
+}
+
+void pwmSetMode(int mode)
+{
+}
+
+void pwmSetRange(unsigned int range)
+{
+}
+
+void pwmSetClock(int divisor)
+{
+}
+
+void pwmWrite(int pin, int value)
+{
+    benchCounters.writes++;
+}
+
+int softToneCreate(int pin)
+{
+    return 0;
+}
+
+void softToneWrite(int pin, int freq)
+{
+}
+
+void delay(unsigned int howLong)
+{
+    benchCounters.delayNs += howLong * 1000000ULL;
+}
+
+void delayMicroseconds(unsigned int howLong)
+{
+    benchCounters.delayNs += howLong * 1000ULL;
+    if (benchRealDelays)
+        clockWaitUntilNs(clockNowNs() + howLong * 1000ULL, BENCH_SPIN_NS);
+}
+
+unsigned int millis(void)
+{
+    return 0;
+}
+
+unsigned int micros(void)
+{
+    return 0;
+}
@@ -0,0 +1,577 @@
+/*
+
+A headless stand-in for wiringPi, wiringShift and softTone, so the game can run off the Pi.
+
+Build the game with `-Isim`, the sources in `sim/` and `@sim/wrap.opts` instead of linking
+wiringPi. Pin writes are decoded the way the real chips would see them:
+
+- The LED matrix's chain of 74HC595 pairs: every latch shows one row on each panel, and a scan of
+  all rows makes a frame. The number of panels is taken from how many bytes each latch shifts in.
+  A pixel counts as lit if it is lit in any bit-plane of its row.
+- The LED bar's MY9221: 16 bit words are clocked in on both clock edges, and the last frame's
+  command word and levels are taken when the data line is pulsed with the clock held.
+- The joystick's ADC0832: the channel is clocked in, and the scripted stick position is clocked out
+  MSB first and then LSB first, like the real chip.
+- The buzzer's tone, from softTone or from the PWM registers.
+
+Time runs on virtual time (sim_clock.c): it only moves on once every thread is waiting, straight to
+the next deadline, so a session plays as fast as the threads can compute it and every run with the
+same seed and script decodes the same pins at the same times.
+
+The simulation is configured through the environment:
+
+- `SIM_REALTIME`: if set, runs on real time instead, for watching the game play out.
+- `SIM_JOYSTICK`: a joystick script. Each line is `<ms> <x> <y> <button>`, setting the stick from
+  that many milliseconds after setup on. Lines starting with `#` are ignored.
+- `SIM_DURATION_MS`: ends the program after this long, printing a summary.
+- `SIM_LOG`: if set, prints every new matrix frame, bar frame and tone.
+
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "sim.h"
+#include "softTone.h"
+#include "wiringPi.h"
+#include "wiringShift.h"
+
+// Pins, as wired in the drivers.
+#define MATRIX_LATCH 6
+#define MATRIX_DATA 11
+#define BAR_CLK 4
+#define BAR_DATA 5
+#define ADC_DATA 27
+#define ADC_CLK 28
+#define ADC_CS 29
+#define JOYSTICK_Z 22
+#define BUZZER 26
+
+#define PIN_COUNT 64
+
+// The most matrix panels the chain can have, each a row and a column register.
+#define MATRIX_MAX_PANELS 8
+#define MATRIX_CHAIN_BYTES (MATRIX_MAX_PANELS * 2)
+
+// A MY9221 frame is a command word and 12 channel words.
+#define BAR_WORDS 13
+#define BAR_LEDS 10
+
+// The MY9221 latches after this many data pulses with the clock held.
+#define BAR_LATCH_PULSES 4
+
+// Delays shorter than this much real time spin, like wiringPi's.
+#define SPIN_NS 50000
+
+// The PWM clock before the divisor.
+#define PWM_BASE_CLOCK 19200000
+
+// A point of the joystick script.
+typedef struct
+{
+    uint64_t timeMs;
+    int x;
+    int y;
+    int button;
+} ScriptStep;
+
+static void *stopAfter(void *arg);
+static void loadScript(const char *path);
+static const ScriptStep *scriptAt(uint64_t timeMs);
+static void matrixLatch();
+static int matrixRow(unsigned char rowBits);
+static void barClock(int data);
+static void barLatch();
+static void adcClock();
+static void setTone(int newTone);
+static uint64_t elapsedMs();
+
+// When the simulation was set up, on the clock and in real time, and whether it logs what it decodes.
+static uint64_t startNs = 0;
+static uint64_t startRealNs = 0;
+static int logging = 0;
+
+static int pinLevels[PIN_COUNT];
+
+// The matrix chain's shift registers, with the panel nearest the Pi last, the bytes shifted in since
+// the last latch, the frame being scanned on every panel, and the last complete frame.
+// Only touched by the matrix render thread.
+static unsigned char matrixChain[MATRIX_CHAIN_BYTES];
+static int matrixShifted = 0;
+static int matrixPanels = 1;
+static int matrixLastRow = -1;
+static unsigned char matrixScan[MATRIX_MAX_PANELS][8];
+static unsigned char matrixShown[MATRIX_MAX_PANELS][8];
+
+// The bar's shift register and words. Only touched by the LED bar thread.
+static unsigned int barBits = 0;
+static int barBitCount = 0;
+static unsigned short barWords[BAR_WORDS];
+static unsigned long barWordCount = 0;
+static int barPulses = 0;
+static unsigned short barCommand = 0;
+static unsigned short barShown[BAR_LEDS];
+
+// The ADC transfer in progress. Only touched by the joystick sampler thread.
+static int adcEdges = 0;
+static int adcAddress = 0;
+static int adcValue = 0;
+static int adcOut = 0;
+
+// The joystick script, and the position set through `simJoystickSet`, which overrides it.
+static ScriptStep *script = NULL;
+static int scriptLength = 0;
+static ScriptStep manual;
+static atomic_int manualSet = 0;
+
+// The buzzer's tone, and the PWM registers it may come from.
+static atomic_int tone = 0;
+static int pwmDivisor = 1;
+static unsigned int pwmRange = 1024;
+
+// Statistics.
+static atomic_ulong matrixScans = 0;
+static atomic_ulong matrixChanges = 0;
+static atomic_ulong barFrames = 0;
+static atomic_ulong adcTransfers = 0;
+static atomic_ulong toneChanges = 0;
+
+// Configures the simulation from the environment.
+int wiringPiSetup(void)
+{
+    int realtime = getenv("SIM_REALTIME") != NULL;
+    if (!realtime)
+        simClockStart();
+
+    startNs = clockNowNs();
+    startRealNs = simClockRealNowNs();
+    logging = getenv("SIM_LOG") != NULL;
+
+    for (int pin = 0; pin < PIN_COUNT; pin++)
+        pinLevels[pin] = LOW;
+    pinLevels[JOYSTICK_Z] = HIGH;
+
+    const char *path = getenv("SIM_JOYSTICK");
+    if (path)
+        loadScript(path);
+
+    const char *duration = getenv("SIM_DURATION_MS");
+    if (duration)
+    {
+        static uint64_t durationMs;
+        durationMs = strtoull(duration, NULL, 10);
+
+        pthread_t stop_thread;
+        pthread_create(&stop_thread, NULL, stopAfter, &durationMs);
+    }
+
+    printf("Simulating wiringPi on %s time\n", realtime ? "real" : "virtual");
+    return 0;
+}
+
+void pinMode(int pin, int mode)
+{
+}
+
+void digitalWrite(int pin, int value)
+{
+    if (pin < 0 || pin >= PIN_COUNT)
+        return;
+
+    value = value != LOW;
+    int previous = pinLevels[pin];
+    pinLevels[pin] = value;
+
+    if (value == previous)
+        return;
+
+    switch (pin)
+    {
+    case MATRIX_LATCH:
+        if (value)
+            matrixLatch();
+        break;
+
+    case BAR_CLK:
+        barClock(pinLevels[BAR_DATA]);
+        break;
+
+    case BAR_DATA:
+        if (value && ++barPulses == BAR_LATCH_PULSES)
+            barLatch();
+        break;
+
+    case ADC_CS:
+        // A falling edge starts a transfer.
+        if (!value)
+        {
+            adcEdges = 0;
+            adcAddress = 0;
+        }
+        break;
+
+    case ADC_CLK:
+        if (value && !pinLevels[ADC_CS])
+            adcClock();
+        break;
+    }
+}
+
+int digitalRead(int pin)
+{
+    if (pin == ADC_DATA)
+        return adcOut;
+
+    if (pin == JOYSTICK_Z)
+        return !scriptAt(elapsedMs())->button;
+
+    if (pin < 0 || pin >= PIN_COUNT)
+        return LOW;
+
+    return pinLevels[pin];
+}
+
+void shiftOut(uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val)
+{
+    if (dPin != MATRIX_DATA)
+        return;
+
+    if (order == LSBFIRST)
+    {
+        uint8_t reversed = 0;
+        for (int i = 0; i < 8; i++)
+            reversed |= ((val >> i) & 1) << (7 - i);
+        val = reversed;
+    }
+
+    memmove(matrixChain, matrixChain + 1, MATRIX_CHAIN_BYTES - 1);
+    matrixChain[MATRIX_CHAIN_BYTES - 1] = val;
+    matrixShifted++;
+}
+
+void pwmSetMode(int mode)
+{
+}
+
+void pwmSetRange(unsigned int range)
+{
+    pwmRange = range ? range : 1;
+}
+
+void pwmSetClock(int divisor)
+{
+    pwmDivisor = divisor > 0 ? divisor : 1;
+}
+
+void pwmWrite(int pin, int value)
+{
+    if (pin == BUZZER)
+        setTone(value ? PWM_BASE_CLOCK / pwmDivisor / pwmRange : 0);
+}
+
+int softToneCreate(int pin)
+{
+    return 0;
+}
+
+void softToneWrite(int pin, int freq)
+{
+    if (pin == BUZZER)
+        setTone(freq);
+}
+
+void delay(unsigned int howLong)
+{
+    clockSleepUntilNs(clockNowNs() + howLong * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int howLong)
+{
+    clockWaitUntilNs(clockNowNs() + howLong * 1000ULL, SPIN_NS);
+}
+
+unsigned int millis(void)
+{
+    return elapsedMs();
+}
+
+unsigned int micros(void)
+{
+    return (clockNowNs() - startNs) / 1000;
+}
+
+// Copies the last complete frame of a matrix panel, counted from the one nearest the Pi, one byte
+// per row with the MSB being the left-most column.
+void simMatrixFrame(int panel, unsigned char rows[8])
+{
+    memcpy(rows, matrixShown[panel >= 0 && panel < MATRIX_MAX_PANELS ? panel : 0], 8);
+}
+
+// Returns how many panels the matrix chain was last scanned with.
+int simMatrixPanels()
+{
+    return matrixPanels;
+}
+
+// Copies the levels of the last frame the LED bar latched.
+void simBarLevels(unsigned short levels[10])
+{
+    memcpy(levels, barShown, sizeof(barShown));
+}
+
+// Returns the tone the buzzer is playing, in Hz, or 0 if it is silent.
+int simBuzzerTone()
+{
+    return atomic_load_explicit(&tone, memory_order_relaxed);
+}
+
+// Holds the joystick in a position, overriding the script from now on.
+void simJoystickSet(int x, int y, int button)
+{
+    manual.x = x;
+    manual.y = y;
+    manual.button = button;
+    atomic_store_explicit(&manualSet, 1, memory_order_release);
+}
+
+// Fills `stats` with what the simulated peripherals have been sent so far.
+void simGetStats(SimStats *stats)
+{
+    stats->matrixScans = atomic_load_explicit(&matrixScans, memory_order_relaxed);
+    stats->matrixChanges = atomic_load_explicit(&matrixChanges, memory_order_relaxed);
+    stats->barFrames = atomic_load_explicit(&barFrames, memory_order_relaxed);
+    stats->adcTransfers = atomic_load_explicit(&adcTransfers, memory_order_relaxed);
+    stats->toneChanges = atomic_load_explicit(&toneChanges, memory_order_relaxed);
+}
+
+// Ends the program once the clock has run for `*arg` milliseconds, printing a summary.
+static void *stopAfter(void *arg)
+{
+    uint64_t durationMs = *(uint64_t *)arg;
+    clockSleepUntilNs(startNs + durationMs * 1000000ULL);
+
+    SimStats stats;
+    simGetStats(&stats);
+
+    uint64_t realMs = (simClockRealNowNs() - startRealNs) / 1000000;
+
+    printf("Simulated %lums in %lums: %lu matrix scans (%lu frames), %lu bar frames, %lu ADC transfers, %lu tones\n",
+           (unsigned long)durationMs, (unsigned long)realMs, stats.matrixScans, stats.matrixChanges,
+           stats.barFrames, stats.adcTransfers, stats.toneChanges);
+    exit(0);
+
+    return NULL;
+}
+
+// Loads a joystick script, keeping its steps in time order.
+static void loadScript(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror("Failed to open joystick script");
+        return;
+    }
+
+    char line[128];
+    int capacity = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        ScriptStep step;
+        unsigned long long timeMs;
+
+        if (line[0] == '#' || sscanf(line, "%llu %d %d %d", &timeMs, &step.x, &step.y, &step.button) != 4)
+            continue;
+
+        step.timeMs = timeMs;
+        if (scriptLength && step.timeMs < script[scriptLength - 1].timeMs)
+            continue;
+
+        if (scriptLength == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            script = realloc(script, capacity * sizeof(ScriptStep));
+        }
+
+        script[scriptLength++] = step;
+    }
+
+    fclose(file);
+}
+
+// Returns the joystick position at `timeMs` after setup. The stick rests centered before the script starts.
+static const ScriptStep *scriptAt(uint64_t timeMs)
+{
+    static const ScriptStep rest = {0, 128, 128, 0};
+
+    if (atomic_load_explicit(&manualSet, memory_order_acquire))
+        return &manual;
+
+    // Find the last step at or before `timeMs`.
+    int low = 0;
+    int high = scriptLength;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (script[middle].timeMs <= timeMs)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low ? &script[low - 1] : &rest;
+}
+
+// Shows the latched row on every panel, and completes the frame being scanned when the scan starts over.
+static void matrixLatch()
+{
+    int panels = matrixShifted / 2;
+    matrixShifted = 0;
+    if (panels < 1)
+        return;
+    if (panels > MATRIX_MAX_PANELS)
+        panels = MATRIX_MAX_PANELS;
+
+    // Panel p's row and column bytes sit 2p bytes further down the chain than the nearest panel's.
+    int rows[MATRIX_MAX_PANELS];
+    for (int p = 0; p < panels; p++)
+        rows[p] = matrixRow(matrixChain[MATRIX_CHAIN_BYTES - 2 - 2 * p]);
+
+    int row = rows[0];
+    if (row == -1)
+        return;
+
+    if (row < matrixLastRow)
+    {
+        atomic_fetch_add_explicit(&matrixScans, 1, memory_order_relaxed);
+
+        if (memcmp(matrixScan, matrixShown, sizeof(matrixScan)) != 0)
+        {
+            memcpy(matrixShown, matrixScan, sizeof(matrixScan));
+            atomic_fetch_add_explicit(&matrixChanges, 1, memory_order_relaxed);
+
+            if (logging)
+            {
+                printf("[sim %6lu] matrix:", (unsigned long)elapsedMs());
+                for (int p = 0; p < matrixPanels; p++)
+                {
+                    if (p)
+                        printf(" |");
+                    for (int i = 0; i < 8; i++)
+                        printf(" %02x", matrixShown[p][i]);
+                }
+                printf("\n");
+            }
+        }
+
+        memset(matrixScan, 0, sizeof(matrixScan));
+        matrixPanels = panels;
+    }
+
+    // A row may be latched once per bit-plane, a pixel lit in any of them counts.
+    for (int p = 0; p < panels; p++)
+    {
+        if (rows[p] == -1)
+            continue;
+
+        if (row != matrixLastRow)
+            matrixScan[p][rows[p]] = 0;
+        matrixScan[p][rows[p]] |= (unsigned char)~matrixChain[MATRIX_CHAIN_BYTES - 1 - 2 * p];
+    }
+    matrixLastRow = row;
+}
+
+// Returns which row a row register byte lights, or -1 if it does not light exactly one.
+static int matrixRow(unsigned char rowBits)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        if (rowBits == (0x80 >> i))
+            return i;
+    }
+
+    return -1;
+}
+
+// Takes a data bit in on a clock edge.
+static void barClock(int data)
+{
+    barPulses = 0;
+    barBits = (barBits << 1) | data;
+
+    if (++barBitCount == 16)
+    {
+        barWords[barWordCount++ % BAR_WORDS] = barBits;
+        barBits = 0;
+        barBitCount = 0;
+    }
+}
+
+// Latches the last frame clocked in.
+static void barLatch()
+{
+    if (barWordCount < BAR_WORDS)
+        return;
+
+    barCommand = barWords[barWordCount % BAR_WORDS];
+    for (int i = 0; i < BAR_LEDS; i++)
+        barShown[i] = barWords[(barWordCount + 1 + i) % BAR_WORDS];
+
+    barWordCount = 0;
+    atomic_fetch_add_explicit(&barFrames, 1, memory_order_relaxed);
+
+    if (logging)
+    {
+        printf("[sim %6lu] bar %04x:", (unsigned long)elapsedMs(), barCommand);
+        for (int i = 0; i < BAR_LEDS; i++)
+            printf(" %5u", barShown[i]);
+        printf("\n");
+    }
+}
+
+// Clocks the ADC on a rising edge: the start, mode and channel bits are clocked in, one clock lets
+// the multiplexer settle, then the sample is clocked out MSB first, then LSB first sharing B0.
+static void adcClock()
+{
+    adcEdges++;
+
+    if (adcEdges <= 3)
+    {
+        adcAddress = (adcAddress << 1) | pinLevels[ADC_DATA];
+        if (adcEdges == 3)
+        {
+            const ScriptStep *step = scriptAt(elapsedMs());
+            adcValue = (adcAddress & 1) ? step->y : step->x;
+            atomic_fetch_add_explicit(&adcTransfers, 1, memory_order_relaxed);
+        }
+        return;
+    }
+
+    if (adcEdges >= 5 && adcEdges <= 12)
+        adcOut = (adcValue >> (12 - adcEdges)) & 1;
+    else if (adcEdges >= 13 && adcEdges <= 19)
+        adcOut = (adcValue >> (adcEdges - 12)) & 1;
+}
+
+// Records a new buzzer tone.
+static void setTone(int newTone)
+{
+    if (atomic_exchange_explicit(&tone, newTone, memory_order_relaxed) == newTone)
+        return;
+
+    atomic_fetch_add_explicit(&toneChanges, 1, memory_order_relaxed);
+    if (logging)
+        printf("[sim %6lu] tone %d\n", (unsigned long)elapsedMs(), newTone);
+}
+
+// Returns the clock time since setup, in milliseconds.
+static uint64_t elapsedMs()
+{
+    return (clockNowNs() - startNs) / 1000000;
+}
@@ -0,0 +1,25 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// What the simulated peripherals have been sent so far.
+typedef struct
+{
+    unsigned long matrixScans;
+    unsigned long matrixChanges;
+    unsigned long barFrames;
+    unsigned long adcTransfers;
+    unsigned long toneChanges;
+} SimStats;
+
+void simMatrixFrame(int panel, unsigned char rows[8]);
+int simMatrixPanels();
+void simBarLevels(unsigned short levels[10]);
+int simBuzzerTone();
+void simJoystickSet(int x, int y, int button);
+void simGetStats(SimStats *stats);
+void simClockStart();
+uint64_t simClockRealNowNs();
+
+#endif
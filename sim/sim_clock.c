@@ -0,0 +1,617 @@
+/*
+
+Virtual time for the simulator, so a session plays as fast as the threads can compute it, the same
+way every run.
+
+On virtual time only one thread runs at once: it keeps running until it blocks, and then hands over
+to the thread that became ready first. Virtual time stands still while any thread is ready, and only
+moves on once every thread is blocked: it then jumps to the earliest deadline, and readies the thread
+(or fires the timer) waiting for it. Ties go to whichever started waiting first.
+
+For that to hold, the scheduler has to see every thread and every wakeup. The game's drivers know
+nothing about it: the simulator build links with `--wrap` for the calls below (see `wrap.opts`), so
+they come here first and pass straight through until `simClockStart` turns virtual time on.
+
+- `pthread_create` and `pthread_join`, so every thread takes turns, and a joining thread steps aside
+  for the thread it waits for.
+- The clock's `clockNowNs`, `clockSleepUntilNs`, `clockWaitUntilNs` and `clockPoll`, where threads
+  read the time and block.
+- `write`, which readies the threads waiting on the fd written, like an eventfd being signalled.
+- `epoll_ctl` and `epoll_wait`, so a write to an fd in an epoll set readies the threads waiting on
+  the epoll fd.
+- `timerfd_create` and `timerfd_settime`, which make one-shot timers fire on virtual time.
+
+Threads must not block anywhere else, except on mutexes that are never held across those. Wakeups
+from outside the program still work: the thread they wake queues up for its turn like any other, at
+whatever point it sees the wakeup.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "clock.h"
+#include "sim.h"
+
+// The most threads and timers on virtual time.
+#define MAX_WAITERS 64
+
+// The most fds that can be tied to the epoll fd they are polled through.
+#define MAX_WATCHES 32
+
+// The most fds a thread can poll at once on virtual time.
+#define MAX_POLL_FDS 16
+
+// Fds below this can be virtual timers.
+#define MAX_FDS 1024
+
+#define NO_DEADLINE UINT64_MAX
+
+typedef enum
+{
+    WAITER_RUNNING,
+    WAITER_READY,
+    WAITER_BLOCKED,
+    // Blocked outside the scheduler, like in pthread_join.
+    WAITER_AWAY,
+    WAITER_TIMER,
+} WaiterState;
+
+// A thread on virtual time, or an armed timer.
+typedef struct
+{
+    int inUse;
+    WaiterState state;
+    // The eventfd the thread is handed its turn through, or the timer's fd.
+    int fd;
+    // What a blocked thread waits on besides its deadline.
+    const struct pollfd *fds;
+    int count;
+    uint64_t deadline;
+    // When the thread started waiting or became ready, to break ties.
+    uint64_t order;
+} Waiter;
+
+// An fd in the epoll set `waitFd`, whose wakeups also wake threads polling `waitFd`.
+typedef struct
+{
+    int fd;
+    int waitFd;
+} Watch;
+
+// A thread started on virtual time.
+typedef struct
+{
+    void *(*start)(void *);
+    void *arg;
+    Waiter *waiter;
+} ThreadStart;
+
+// The wrapped calls, as the linker names the originals.
+int __real_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *), void *arg);
+int __real_pthread_join(pthread_t thread, void **result);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+int __real_timerfd_create(int clockid, int flags);
+int __real_timerfd_settime(int fd, int flags, const struct itimerspec *value, struct itimerspec *old);
+uint64_t __real_clockNowNs();
+void __real_clockSleepUntilNs(uint64_t deadline);
+void __real_clockWaitUntilNs(uint64_t deadline, uint64_t spinNs);
+int __real_clockPoll(struct pollfd *fds, int count, int64_t timeoutNs);
+
+static void *runThread(void *arg);
+static int waitVirtual(struct pollfd *fds, int count, uint64_t deadline);
+static void awaitTurnLocked(struct pollfd *fds, int count);
+static void enterLocked();
+static void switchLocked();
+static Waiter *nextReadyLocked();
+static Waiter *nextDueLocked();
+static void readyLocked(Waiter *waiter);
+static void notifyLocked(int fd);
+static int waitsOn(const Waiter *waiter, int fd);
+static Waiter *addWaiterLocked();
+static void lockVirtual();
+static void unlockVirtual();
+static void drain(int fd);
+
+// Whether the program runs on virtual time. Only changed before any other thread starts.
+static int virtualTime = 0;
+
+// Virtual time, in nanoseconds.
+static atomic_uint_least64_t virtualNs = 0;
+
+// Safety: Everything below is only touched with `virtualLock` held.
+static pthread_mutex_t virtualLock = PTHREAD_MUTEX_INITIALIZER;
+static Waiter waiters[MAX_WAITERS];
+static Watch watches[MAX_WATCHES];
+static int watchCount = 0;
+static unsigned char timerFds[MAX_FDS];
+static uint64_t nextOrder = 0;
+
+// The thread whose turn it is, or NULL if every thread is blocked on something from outside.
+static Waiter *current = NULL;
+
+// The calling thread's waiter on virtual time, and whether it holds `virtualLock`, for a signal
+// handler that writes an fd while it does.
+static __thread Waiter *self = NULL;
+static __thread int lockHeld = 0;
+
+// Makes the program run on virtual time from now on, starting at the real time.
+// Must be called from the main thread before any other thread is started.
+void simClockStart()
+{
+    atomic_store(&virtualNs, __real_clockNowNs());
+    virtualTime = 1;
+
+    lockVirtual();
+    enterLocked();
+    unlockVirtual();
+}
+
+// Returns the real monotonic time in nanoseconds, even on virtual time, for measuring how long work takes.
+uint64_t simClockRealNowNs()
+{
+    return __real_clockNowNs();
+}
+
+uint64_t __wrap_clockNowNs()
+{
+    if (virtualTime)
+        return atomic_load_explicit(&virtualNs, memory_order_acquire);
+
+    return __real_clockNowNs();
+}
+
+void __wrap_clockSleepUntilNs(uint64_t deadline)
+{
+    if (!virtualTime)
+    {
+        __real_clockSleepUntilNs(deadline);
+        return;
+    }
+
+    waitVirtual(NULL, 0, deadline);
+}
+
+// Virtual time is never late, so there is nothing to spin for.
+void __wrap_clockWaitUntilNs(uint64_t deadline, uint64_t spinNs)
+{
+    if (!virtualTime)
+    {
+        __real_clockWaitUntilNs(deadline, spinNs);
+        return;
+    }
+
+    waitVirtual(NULL, 0, deadline);
+}
+
+int __wrap_clockPoll(struct pollfd *fds, int count, int64_t timeoutNs)
+{
+    if (!virtualTime || timeoutNs == 0)
+        return __real_clockPoll(fds, count, timeoutNs);
+
+    return waitVirtual(fds, count, timeoutNs < 0 ? NO_DEADLINE : __wrap_clockNowNs() + timeoutNs);
+}
+
+// On virtual time the thread is ready from the start, and first runs once the calling thread blocks.
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *), void *arg)
+{
+    if (!virtualTime)
+        return __real_pthread_create(thread, attr, start, arg);
+
+    ThreadStart *threadStart = malloc(sizeof(ThreadStart));
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!threadStart || fd == -1)
+    {
+        free(threadStart);
+        if (fd != -1)
+            close(fd);
+        return ENOMEM;
+    }
+
+    lockVirtual();
+    Waiter *waiter = addWaiterLocked();
+    if (waiter)
+    {
+        *waiter = (Waiter){.inUse = 1, .fd = fd};
+        readyLocked(waiter);
+    }
+    unlockVirtual();
+
+    int result = waiter ? 0 : EAGAIN;
+    if (waiter)
+    {
+        *threadStart = (ThreadStart){start, arg, waiter};
+        result = __real_pthread_create(thread, attr, runThread, threadStart);
+    }
+
+    if (result != 0)
+    {
+        free(threadStart);
+        close(fd);
+        lockVirtual();
+        if (waiter)
+            waiter->inUse = 0;
+        unlockVirtual();
+    }
+
+    return result;
+}
+
+// On virtual time the calling thread steps aside meanwhile, so the thread can have its turns.
+int __wrap_pthread_join(pthread_t thread, void **result)
+{
+    if (!virtualTime)
+        return __real_pthread_join(thread, result);
+
+    lockVirtual();
+    enterLocked();
+    self->state = WAITER_AWAY;
+    switchLocked();
+    unlockVirtual();
+
+    int error = __real_pthread_join(thread, result);
+
+    lockVirtual();
+    readyLocked(self);
+    if (!current)
+        switchLocked();
+    awaitTurnLocked(NULL, 0);
+    unlockVirtual();
+
+    return error;
+}
+
+// Readies the threads waiting on `fd` before writing it. A signal handler interrupting a thread that
+// holds the lock writes straight away, and wakes them from outside.
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+    if (!virtualTime || lockHeld)
+        return __real_write(fd, buf, count);
+
+    lockVirtual();
+    notifyLocked(fd);
+    ssize_t written = __real_write(fd, buf, count);
+    unlockVirtual();
+
+    return written;
+}
+
+// Notes which fds each epoll set holds.
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    int result = __real_epoll_ctl(epfd, op, fd, event);
+    if (result == -1)
+        return result;
+
+    lockVirtual();
+    if (op == EPOLL_CTL_ADD && watchCount < MAX_WATCHES)
+        watches[watchCount++] = (Watch){fd, epfd};
+    else if (op == EPOLL_CTL_DEL)
+    {
+        for (int i = 0; i < watchCount; i++)
+        {
+            if (watches[i].fd == fd && watches[i].waitFd == epfd)
+                watches[i--] = watches[--watchCount];
+        }
+    }
+    unlockVirtual();
+
+    return result;
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    if (!virtualTime || timeout == 0)
+        return __real_epoll_wait(epfd, events, maxevents, timeout);
+
+    struct pollfd fd = {.fd = epfd, .events = POLLIN};
+    int ready = waitVirtual(&fd, 1, timeout < 0 ? NO_DEADLINE : __wrap_clockNowNs() + timeout * 1000000ULL);
+    if (ready <= 0)
+        return ready;
+
+    return __real_epoll_wait(epfd, events, maxevents, 0);
+}
+
+// On virtual time a timer is an eventfd, signalled when virtual time reaches its expiry.
+int __wrap_timerfd_create(int clockid, int flags)
+{
+    if (!virtualTime)
+        return __real_timerfd_create(clockid, flags);
+
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1 || fd >= MAX_FDS)
+    {
+        if (fd != -1)
+            close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+
+    lockVirtual();
+    timerFds[fd] = 1;
+    unlockVirtual();
+
+    return fd;
+}
+
+// Arms a virtual timer once, replacing any earlier expiry. Intervals are not supported.
+int __wrap_timerfd_settime(int fd, int flags, const struct itimerspec *value, struct itimerspec *old)
+{
+    if (fd < 0 || fd >= MAX_FDS || !timerFds[fd])
+        return __real_timerfd_settime(fd, flags, value, old);
+
+    if (old)
+        *old = (struct itimerspec){0};
+
+    uint64_t ns = (uint64_t)value->it_value.tv_sec * 1000000000ULL + value->it_value.tv_nsec;
+    uint64_t deadline = flags & TFD_TIMER_ABSTIME ? ns : __wrap_clockNowNs() + ns;
+
+    lockVirtual();
+    for (int i = 0; i < MAX_WAITERS; i++)
+    {
+        if (waiters[i].inUse && waiters[i].state == WAITER_TIMER && waiters[i].fd == fd)
+            waiters[i].inUse = 0;
+    }
+
+    // Like timerfd_settime, re-arming forgets an expiry that was not read yet.
+    drain(fd);
+
+    Waiter *timer = ns ? addWaiterLocked() : NULL;
+    if (timer)
+        *timer = (Waiter){.inUse = 1, .state = WAITER_TIMER, .fd = fd, .deadline = deadline, .order = nextOrder++};
+    unlockVirtual();
+
+    return 0;
+}
+
+// Runs a thread started on virtual time once it gets its first turn, and hands the turn on once it
+// returns.
+static void *runThread(void *arg)
+{
+    ThreadStart threadStart = *(ThreadStart *)arg;
+    free(arg);
+
+    lockVirtual();
+    self = threadStart.waiter;
+    awaitTurnLocked(NULL, 0);
+    unlockVirtual();
+
+    void *result = threadStart.start(threadStart.arg);
+
+    lockVirtual();
+    int fd = self->fd;
+    self->inUse = 0;
+    switchLocked();
+    self = NULL;
+    unlockVirtual();
+
+    close(fd);
+    return result;
+}
+
+// Blocks the calling thread on virtual time until `deadline`, or until one of `fds` is ready.
+// Returns how many of `fds` are ready, or -1 on error, like poll().
+static int waitVirtual(struct pollfd *fds, int count, uint64_t deadline)
+{
+    if (count > MAX_POLL_FDS)
+        count = MAX_POLL_FDS;
+
+    lockVirtual();
+    enterLocked();
+
+    int result = count ? poll(fds, count, 0) : 0;
+    if (result == 0 && deadline > __wrap_clockNowNs())
+    {
+        self->state = WAITER_BLOCKED;
+        self->fds = fds;
+        self->count = count;
+        self->deadline = deadline;
+        self->order = nextOrder++;
+
+        switchLocked();
+        awaitTurnLocked(fds, count);
+        result = count ? poll(fds, count, 0) : 0;
+    }
+
+    unlockVirtual();
+    return result;
+}
+
+// Waits until it is the calling thread's turn. While the thread is blocked, `fds` becoming ready
+// without a wrapped write is a wakeup from outside the program, which readies it.
+static void awaitTurnLocked(struct pollfd *fds, int count)
+{
+    while (current != self)
+    {
+        int blocked = self->state == WAITER_BLOCKED ? count : 0;
+        unlockVirtual();
+
+        struct pollfd all[MAX_POLL_FDS + 1];
+        for (int i = 0; i < blocked; i++)
+            all[i] = fds[i];
+        all[blocked] = (struct pollfd){.fd = self->fd, .events = POLLIN};
+
+        int ready = ppoll(all, blocked + 1, NULL, NULL);
+        drain(self->fd);
+
+        lockVirtual();
+        if (self->state == WAITER_BLOCKED && ready > (all[blocked].revents ? 1 : 0))
+        {
+            readyLocked(self);
+            if (!current)
+                switchLocked();
+        }
+    }
+}
+
+// Puts the calling thread on virtual time, if it was not started on it, and waits for its turn.
+static void enterLocked()
+{
+    if (self)
+        return;
+
+    self = addWaiterLocked();
+    if (!self)
+        abort();
+
+    *self = (Waiter){.inUse = 1, .fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+    readyLocked(self);
+    if (!current)
+        switchLocked();
+    awaitTurnLocked(NULL, 0);
+}
+
+// Hands the turn from the calling thread to the thread that became ready first. If none is ready,
+// moves virtual time on to the earliest deadline, readying whatever waits for it, until one is.
+static void switchLocked()
+{
+    Waiter *next;
+    while (!(next = nextReadyLocked()))
+    {
+        Waiter *due = nextDueLocked();
+
+        // Every thread waits for something from outside the program.
+        if (!due)
+        {
+            current = NULL;
+            return;
+        }
+
+        if (due->deadline > atomic_load_explicit(&virtualNs, memory_order_relaxed))
+            atomic_store_explicit(&virtualNs, due->deadline, memory_order_release);
+
+        if (due->state == WAITER_TIMER)
+        {
+            due->inUse = 0;
+            notifyLocked(due->fd);
+
+            uint64_t one = 1;
+            if (__real_write(due->fd, &one, sizeof(one)) == -1)
+                continue;
+        }
+        else
+            readyLocked(due);
+    }
+
+    next->state = WAITER_RUNNING;
+    current = next;
+
+    if (next != self)
+    {
+        uint64_t one = 1;
+        if (__real_write(next->fd, &one, sizeof(one)) == -1)
+            return;
+    }
+}
+
+// Returns the thread that became ready first, or NULL if none is.
+static Waiter *nextReadyLocked()
+{
+    Waiter *next = NULL;
+    for (int i = 0; i < MAX_WAITERS; i++)
+    {
+        Waiter *waiter = &waiters[i];
+        if (waiter->inUse && waiter->state == WAITER_READY && (!next || waiter->order < next->order))
+            next = waiter;
+    }
+
+    return next;
+}
+
+// Returns the blocked thread or timer with the earliest deadline, or NULL if there is none.
+static Waiter *nextDueLocked()
+{
+    Waiter *next = NULL;
+    for (int i = 0; i < MAX_WAITERS; i++)
+    {
+        Waiter *waiter = &waiters[i];
+        if (!waiter->inUse || (waiter->state != WAITER_BLOCKED && waiter->state != WAITER_TIMER) ||
+            waiter->deadline == NO_DEADLINE)
+            continue;
+
+        if (!next || waiter->deadline < next->deadline || (waiter->deadline == next->deadline && waiter->order < next->order))
+            next = waiter;
+    }
+
+    return next;
+}
+
+// Queues a thread for its turn.
+static void readyLocked(Waiter *waiter)
+{
+    waiter->state = WAITER_READY;
+    waiter->order = nextOrder++;
+}
+
+// Readies every thread blocked on `fd`, which is about to be written.
+static void notifyLocked(int fd)
+{
+    for (int i = 0; i < MAX_WAITERS; i++)
+    {
+        Waiter *waiter = &waiters[i];
+        if (waiter->inUse && waiter->state == WAITER_BLOCKED && waitsOn(waiter, fd))
+            readyLocked(waiter);
+    }
+}
+
+// Returns whether a blocked thread is woken by a write to `fd`.
+static int waitsOn(const Waiter *waiter, int fd)
+{
+    for (int i = 0; i < waiter->count; i++)
+    {
+        if (waiter->fds[i].fd == fd)
+            return 1;
+
+        for (int w = 0; w < watchCount; w++)
+        {
+            if (watches[w].fd == fd && watches[w].waitFd == waiter->fds[i].fd)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Returns a free waiter, or NULL if there are none left.
+static Waiter *addWaiterLocked()
+{
+    for (int i = 0; i < MAX_WAITERS; i++)
+    {
+        if (!waiters[i].inUse)
+            return &waiters[i];
+    }
+
+    return NULL;
+}
+
+static void lockVirtual()
+{
+    pthread_mutex_lock(&virtualLock);
+    lockHeld = 1;
+}
+
+static void unlockVirtual()
+{
+    lockHeld = 0;
+    pthread_mutex_unlock(&virtualLock);
+}
+
+// Resets an eventfd's counter, if it was signalled.
+static void drain(int fd)
+{
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) == -1)
+        return;
+}
@@ -0,0 +1,7 @@
+#ifndef SIM_SOFT_TONE_H
+#define SIM_SOFT_TONE_H
+
+int softToneCreate(int pin);
+void softToneWrite(int pin, int freq);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SIM_WIRING_PI_H
+#define SIM_WIRING_PI_H
+
+// The subset of wiringPi the game uses, implemented by sim.c.
+
+#define INPUT 0
+#define OUTPUT 1
+#define PWM_OUTPUT 2
+
+#define LOW 0
+#define HIGH 1
+
+#define PWM_MODE_MS 0
+#define PWM_MODE_BAL 1
+
+int wiringPiSetup(void);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void pwmSetMode(int mode);
+void pwmSetRange(unsigned int range);
+void pwmSetClock(int divisor);
+void pwmWrite(int pin, int value);
+void delay(unsigned int howLong);
+void delayMicroseconds(unsigned int howLong);
+unsigned int millis(void);
+unsigned int micros(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef SIM_WIRING_SHIFT_H
+#define SIM_WIRING_SHIFT_H
+
+#include <stdint.h>
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+void shiftOut(uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+
+The animation engine for the LED matrix, driven by the render thread.
+
+An animation is a list of keyframes. Each keyframe brings a packed frame onto the matrix with a
+transition, then holds it. Transition frames are never stored: every step computes the frame in
+between from the two packed source frames and how far into the transition we are.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "animation.h"
+
+static void packedToFrame(const unsigned char packed[8], LedMatrixFrame *out);
+static void composeTransition(LedMatrixTransition transition, const unsigned char from[8], const unsigned char to[8],
+                              uint64_t elapsed, uint64_t duration, LedMatrixFrame *out);
+
+// Starts playing `animation` at `now`, transitioning from the packed frame `from`.
+void animatorStart(Animator *animator, const LedMatrixAnimation *animation, const unsigned char from[8], uint64_t now)
+{
+    animator->animation = animation;
+    animator->index = 0;
+    animator->keyframeStart = now;
+    memcpy(animator->from, from, SIZE);
+
+    // A looping animation that takes no time would never let the render thread go.
+    unsigned long total = 0;
+    for (int i = 0; i < animation->count; i++)
+        total += animation->keyframes[i].transitionMs + animation->keyframes[i].holdMs;
+
+    animator->loop = animation->loop && total > 0;
+
+    if (animation->count == 0)
+        animator->animation = NULL;
+}
+
+// Computes the frame to show at `now` into `out`.
+// Returns 1 once the animation has finished, leaving its last keyframe in `out`, or 0 otherwise.
+int animatorStep(Animator *animator, uint64_t now, LedMatrixFrame *out)
+{
+    const LedMatrixAnimation *animation = animator->animation;
+    if (!animation)
+        return 0;
+
+    while (1)
+    {
+        const LedMatrixKeyframe *keyframe = &animation->keyframes[animator->index];
+        uint64_t transitionNs = keyframe->transitionMs * 1000000ULL;
+        uint64_t holdNs = keyframe->holdMs * 1000000ULL;
+        uint64_t elapsed = now - animator->keyframeStart;
+
+        if (elapsed < transitionNs)
+        {
+            composeTransition(keyframe->transition, animator->from, keyframe->frame, elapsed, transitionNs, out);
+            return 0;
+        }
+
+        if (elapsed < transitionNs + holdNs)
+        {
+            packedToFrame(keyframe->frame, out);
+            return 0;
+        }
+
+        // This keyframe is over, the next one transitions from it.
+        memcpy(animator->from, keyframe->frame, SIZE);
+        animator->keyframeStart += transitionNs + holdNs;
+        animator->index++;
+
+        if (animator->index == animation->count)
+        {
+            if (animator->loop)
+            {
+                animator->index = 0;
+                continue;
+            }
+
+            packedToFrame(keyframe->frame, out);
+            animator->animation = NULL;
+            return 1;
+        }
+    }
+}
+
+// Expands a packed frame into a full intensity bit-plane frame.
+static void packedToFrame(const unsigned char packed[8], LedMatrixFrame *out)
+{
+    for (int b = 0; b < LED_MATRIX_BITS; b++)
+        memcpy(out->planes[b], packed, SIZE);
+}
+
+// Computes the frame `elapsed` into a `duration` long transition between two packed frames.
+static void composeTransition(LedMatrixTransition transition, const unsigned char from[8], const unsigned char to[8],
+                              uint64_t elapsed, uint64_t duration, LedMatrixFrame *out)
+{
+    unsigned char packed[SIZE];
+
+    // How many columns or rows have moved so far, from 0 to 7.
+    int step = elapsed * SIZE / duration;
+
+    switch (transition)
+    {
+    case LED_MATRIX_SLIDE_LEFT:
+        for (int row_i = 0; row_i < SIZE; row_i++)
+            packed[row_i] = (from[row_i] << step) | (to[row_i] >> (SIZE - step));
+        break;
+
+    case LED_MATRIX_SLIDE_RIGHT:
+        for (int row_i = 0; row_i < SIZE; row_i++)
+            packed[row_i] = (from[row_i] >> step) | (to[row_i] << (SIZE - step));
+        break;
+
+    case LED_MATRIX_SLIDE_UP:
+        for (int row_i = 0; row_i < SIZE; row_i++)
+            packed[row_i] = row_i + step < SIZE ? from[row_i + step] : to[row_i + step - SIZE];
+        break;
+
+    case LED_MATRIX_SLIDE_DOWN:
+        for (int row_i = 0; row_i < SIZE; row_i++)
+            packed[row_i] = row_i >= step ? from[row_i - step] : to[row_i - step + SIZE];
+        break;
+
+    case LED_MATRIX_WIPE:
+    {
+        // Reveal the new frame from the left, one column at a time.
+        unsigned char mask = 0xFF << (SIZE - step);
+        for (int row_i = 0; row_i < SIZE; row_i++)
+            packed[row_i] = (to[row_i] & mask) | (from[row_i] & ~mask);
+        break;
+    }
+
+    case LED_MATRIX_FADE:
+    {
+        // Pixels only in the new frame fade in while pixels only in the old frame fade out.
+        // Pixels in both stay at full intensity.
+        int level = elapsed * (LED_MATRIX_MAX_INTENSITY + 1) / duration;
+        for (int row_i = 0; row_i < SIZE; row_i++)
+        {
+            unsigned char both = from[row_i] & to[row_i];
+            unsigned char fadeIn = to[row_i] & ~both;
+            unsigned char fadeOut = from[row_i] & ~both;
+
+            for (int b = 0; b < LED_MATRIX_BITS; b++)
+            {
+                unsigned char inBits = (level >> b) & 1 ? fadeIn : 0;
+                unsigned char outBits = ((LED_MATRIX_MAX_INTENSITY - level) >> b) & 1 ? fadeOut : 0;
+                out->planes[b][row_i] = both | inBits | outBits;
+            }
+        }
+        return;
+    }
+
+    case LED_MATRIX_CUT:
+    default:
+        memcpy(packed, to, SIZE);
+        break;
+    }
+
+    packedToFrame(packed, out);
+}
@@ -0,0 +1,21 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <stdint.h>
+
+#include "led_matrix.h"
+
+// Plays an animation on the render thread's time base.
+typedef struct
+{
+    const LedMatrixAnimation *animation;
+    int index;
+    int loop;
+    uint64_t keyframeStart;
+    unsigned char from[SIZE];
+} Animator;
+
+void animatorStart(Animator *animator, const LedMatrixAnimation *animation, const unsigned char from[8], uint64_t now);
+int animatorStep(Animator *animator, uint64_t now, LedMatrixFrame *out);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ASSET_FORMAT_H
+#define ASSET_FORMAT_H
+
+#include <stdint.h>
+
+// The layout of an asset pack, shared by the game and the packer (tools/asset_pack.c).
+//
+// A pack is a header followed by four sections, each 4-byte aligned: the frames (8 bytes each,
+// packed like the `_BITS` frames), the frame names, the animations and their keyframes. Names are
+// sorted, so lookups are a binary search and nothing is parsed when the pack is mapped. Fields are
+// little-endian.
+
+#define ASSET_MAGIC "MGAP"
+#define ASSET_VERSION 1
+
+// Names are NUL padded, and may use every byte.
+#define ASSET_NAME_SIZE 16
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t fileSize;
+    uint32_t frameCount;
+    uint32_t framesOffset;
+    uint32_t frameNamesOffset;
+    uint32_t animationCount;
+    uint32_t animationsOffset;
+    uint32_t keyframeCount;
+    uint32_t keyframesOffset;
+    // FNV-1a of the header, with this field zeroed.
+    uint32_t checksum;
+} AssetHeader;
+
+// Names a frame, by its index in the frames section.
+typedef struct
+{
+    char name[ASSET_NAME_SIZE];
+    uint32_t frame;
+} AssetFrameName;
+
+typedef struct
+{
+    char name[ASSET_NAME_SIZE];
+    uint32_t firstKeyframe;
+    uint16_t keyframeCount;
+    uint16_t loop;
+} AssetAnimation;
+
+// A keyframe, with its transition as a `LedMatrixTransition`.
+typedef struct
+{
+    uint32_t frame;
+    uint16_t transition;
+    uint16_t transitionMs;
+    uint16_t holdMs;
+    uint16_t reserved;
+} AssetKeyframe;
+
+// Returns the checksum of a header, ignoring its checksum field.
+static inline uint32_t assetHeaderChecksum(const AssetHeader *header)
+{
+    AssetHeader copy = *header;
+    copy.checksum = 0;
+
+    uint32_t hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&copy;
+    for (unsigned int i = 0; i < sizeof(copy); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+
+    return hash;
+}
+
+#endif
@@ -0,0 +1,349 @@
+/*
+
+Frames and animations loaded from an asset pack (see asset_format.h), instead of the built-in ones.
+
+The pack is memory-mapped read-only and used in place: frames are handed to the matrix as pointers
+into the mapping, so loading a pack only checks its header and section bounds, and only the pages
+holding the art actually shown are ever read in. Lookups are binary searches over the sorted names.
+Animations are turned into `LedMatrixKeyframe` lists the first time they are asked for, and cached.
+
+The pack's directory is watched with inotify. Packs must be replaced atomically, by writing the new
+one to another file and renaming it over the old one, as the packer does. Only the rename is watched
+for, and a pack written in place is not supported: the game may read its pages at any time. When the
+pack is replaced, the new one is mapped and checked, and swapped in if it is valid.
+The render thread may still be playing keyframes from the old mapping, so it is only unmapped once
+the render thread has picked up something published after the swap.
+
+Everything here runs on the game thread.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "asset_format.h"
+#include "assets.h"
+
+typedef struct AssetPack
+{
+    const unsigned char *base;
+    size_t size;
+    const AssetHeader *header;
+
+    // Animations resolved so far, indexed like the pack's animations. Unresolved ones have no keyframes.
+    LedMatrixAnimation *animations;
+
+    // For retired packs, the last frame generation published before the swap, and the next one retired.
+    unsigned long retiredGeneration;
+    struct AssetPack *next;
+} AssetPack;
+
+static AssetPack *mapPack(const char *path);
+static void unmapPack(AssetPack *pack);
+static int sectionFits(uint32_t offset, uint64_t bytes, size_t size);
+static int nameFits(const char *name);
+static int compareName(const char *name, const char *entry);
+static const LedMatrixAnimation *resolveAnimation(AssetPack *pack, uint32_t index);
+
+// The pack in use, and the packs replaced while the render thread may still use them.
+static AssetPack *currentPack = NULL;
+static AssetPack *retiredPacks = NULL;
+
+// The pack's path, the name it is renamed to in its directory, and the inotify fd watching it.
+static char packPath[256];
+static const char *packName = packPath;
+static int watchFd = -1;
+
+// Maps the pack at `path` and watches it for changes.
+// Returns 0 on success, or -1 if the pack is missing or invalid, in which case the built-in art is used.
+int assetsInit(const char *path)
+{
+    snprintf(packPath, sizeof(packPath), "%s", path);
+
+    char directory[sizeof(packPath)];
+    snprintf(directory, sizeof(directory), "%s", packPath);
+    char *slash = strrchr(directory, '/');
+    if (slash)
+    {
+        *slash = '\0';
+        packName = packPath + (slash - directory) + 1;
+    }
+    else
+        snprintf(directory, sizeof(directory), ".");
+
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd == -1 || inotify_add_watch(watchFd, *directory ? directory : "/", IN_MOVED_TO) == -1)
+        perror("Failed to watch the asset pack");
+
+    currentPack = mapPack(packPath);
+    return currentPack ? 0 : -1;
+}
+
+// Returns the inotify fd that becomes readable when the pack's directory changes, or -1.
+int assetsWatchFd()
+{
+    return watchFd;
+}
+
+// Drains the watch fd and swaps in the pack if another file was renamed over it.
+// Returns 1 if a new pack is in use, 0 if nothing changed, or -1 if the new pack was invalid.
+int assetsReload()
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+
+    ssize_t length;
+    while ((length = read(watchFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *p = buffer; p < buffer + length;)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len && strcmp(event->name, packName) == 0)
+                changed = 1;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    if (!changed)
+        return 0;
+
+    AssetPack *pack = mapPack(packPath);
+    if (!pack)
+        return -1;
+
+    if (currentPack)
+    {
+        currentPack->retiredGeneration = ledMatrixFrameGeneration();
+        currentPack->next = retiredPacks;
+        retiredPacks = currentPack;
+    }
+    currentPack = pack;
+
+    printf("Asset pack reloaded: %u frames, %u animations\n", pack->header->frameCount, pack->header->animationCount);
+    return 1;
+}
+
+// Unmaps the retired packs the render thread can no longer be using.
+void assetsCollect()
+{
+    LedMatrixStats stats;
+    ledMatrixGetStats(&stats);
+
+    AssetPack **link = &retiredPacks;
+    while (*link)
+    {
+        AssetPack *pack = *link;
+        if (stats.generation > pack->retiredGeneration)
+        {
+            *link = pack->next;
+            unmapPack(pack);
+        }
+        else
+            link = &pack->next;
+    }
+}
+
+// Returns the number of frames in the pack in use, or 0 if the built-in art is used.
+unsigned long assetsFrameCount()
+{
+    return currentPack ? currentPack->header->frameCount : 0;
+}
+
+// Returns the frame called `name`, or `fallback` if no pack is loaded or it has no such frame.
+// The frame stays valid until the pack is replaced and the matrix has moved on from it.
+const unsigned char *assetsFrame(const char *name, const unsigned char *fallback)
+{
+    if (!currentPack || !nameFits(name))
+        return fallback;
+
+    const AssetHeader *header = currentPack->header;
+    const AssetFrameName *names = (const AssetFrameName *)(currentPack->base + header->frameNamesOffset);
+
+    uint32_t low = 0;
+    uint32_t high = header->frameCount;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        int order = compareName(name, names[middle].name);
+        if (order == 0)
+        {
+            if (names[middle].frame >= header->frameCount)
+                return fallback;
+            return currentPack->base + header->framesOffset + names[middle].frame * SIZE;
+        }
+
+        if (order < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return fallback;
+}
+
+// Returns the animation called `name`, or `fallback` if no pack is loaded, it has no such animation,
+// or the animation is invalid. The animation stays valid as long as its frames do.
+const LedMatrixAnimation *assetsAnimation(const char *name, const LedMatrixAnimation *fallback)
+{
+    if (!currentPack || !nameFits(name))
+        return fallback;
+
+    const AssetHeader *header = currentPack->header;
+    const AssetAnimation *animations = (const AssetAnimation *)(currentPack->base + header->animationsOffset);
+
+    uint32_t low = 0;
+    uint32_t high = header->animationCount;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        int order = compareName(name, animations[middle].name);
+        if (order == 0)
+        {
+            const LedMatrixAnimation *animation = resolveAnimation(currentPack, middle);
+            return animation ? animation : fallback;
+        }
+
+        if (order < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return fallback;
+}
+
+// Maps and checks a pack. Returns NULL if it is missing or invalid.
+static AssetPack *mapPack(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("Failed to open the asset pack");
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(AssetHeader))
+    {
+        printf("Asset pack %s is too small\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = info.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        perror("Failed to map the asset pack");
+        return NULL;
+    }
+
+    // Every offset is checked against the file here, so lookups can trust them.
+    const AssetHeader *header = base;
+    const char *problem = NULL;
+    if (memcmp(header->magic, ASSET_MAGIC, 4) != 0)
+        problem = "not an asset pack";
+    else if (header->version != ASSET_VERSION)
+        problem = "unsupported version";
+    else if (header->checksum != assetHeaderChecksum(header))
+        problem = "header checksum mismatch";
+    else if (header->fileSize != size)
+        problem = "truncated";
+    else if (!sectionFits(header->framesOffset, (uint64_t)header->frameCount * SIZE, size) ||
+             !sectionFits(header->frameNamesOffset, (uint64_t)header->frameCount * sizeof(AssetFrameName), size) ||
+             !sectionFits(header->animationsOffset, (uint64_t)header->animationCount * sizeof(AssetAnimation), size) ||
+             !sectionFits(header->keyframesOffset, (uint64_t)header->keyframeCount * sizeof(AssetKeyframe), size))
+        problem = "section out of bounds";
+
+    // One spare animation, so an empty pack still gets an allocation.
+    AssetPack *pack = problem ? NULL : calloc(1, sizeof(AssetPack));
+    LedMatrixAnimation *animations = pack ? calloc(header->animationCount + 1, sizeof(LedMatrixAnimation)) : NULL;
+    if (!animations)
+    {
+        printf("Asset pack %s rejected: %s\n", path, problem ? problem : "out of memory");
+        free(pack);
+        munmap(base, size);
+        return NULL;
+    }
+
+    pack->base = base;
+    pack->size = size;
+    pack->header = header;
+    pack->animations = animations;
+
+    return pack;
+}
+
+static void unmapPack(AssetPack *pack)
+{
+    for (uint32_t i = 0; i < pack->header->animationCount; i++)
+        free((void *)pack->animations[i].keyframes);
+
+    free(pack->animations);
+    munmap((void *)pack->base, pack->size);
+    free(pack);
+}
+
+// Returns whether a section of `bytes` bytes at `offset` lies within the file, past the header.
+static int sectionFits(uint32_t offset, uint64_t bytes, size_t size)
+{
+    return offset % 4 == 0 && offset >= sizeof(AssetHeader) && offset + bytes <= size;
+}
+
+// Returns whether a name fits in a name entry. Longer names are never looked up, as they would match
+// the entry holding their first ASSET_NAME_SIZE bytes.
+static int nameFits(const char *name)
+{
+    return strnlen(name, ASSET_NAME_SIZE + 1) <= ASSET_NAME_SIZE;
+}
+
+// Compares a name that fits with a NUL padded name entry.
+static int compareName(const char *name, const char *entry)
+{
+    return strncmp(name, entry, ASSET_NAME_SIZE);
+}
+
+// Builds the keyframes of an animation, checking them against the pack. Returns NULL if invalid.
+static const LedMatrixAnimation *resolveAnimation(AssetPack *pack, uint32_t index)
+{
+    LedMatrixAnimation *animation = &pack->animations[index];
+    if (animation->keyframes)
+        return animation;
+
+    const AssetHeader *header = pack->header;
+    const AssetAnimation *entry = (const AssetAnimation *)(pack->base + header->animationsOffset) + index;
+    if (entry->keyframeCount == 0 || (uint64_t)entry->firstKeyframe + entry->keyframeCount > header->keyframeCount)
+        return NULL;
+
+    const AssetKeyframe *source = (const AssetKeyframe *)(pack->base + header->keyframesOffset) + entry->firstKeyframe;
+    LedMatrixKeyframe *keyframes = malloc(entry->keyframeCount * sizeof(LedMatrixKeyframe));
+    if (!keyframes)
+        return NULL;
+
+    for (int i = 0; i < entry->keyframeCount; i++)
+    {
+        if (source[i].frame >= header->frameCount || source[i].transition > LED_MATRIX_FADE)
+        {
+            free(keyframes);
+            return NULL;
+        }
+
+        keyframes[i].frame = pack->base + header->framesOffset + source[i].frame * SIZE;
+        keyframes[i].transition = source[i].transition;
+        keyframes[i].transitionMs = source[i].transitionMs;
+        keyframes[i].holdMs = source[i].holdMs;
+    }
+
+    animation->keyframes = keyframes;
+    animation->count = entry->keyframeCount;
+    animation->loop = entry->loop != 0;
+
+    return animation;
+}
@@ -0,0 +1,14 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "led_matrix.h"
+
+int assetsInit(const char *path);
+int assetsWatchFd();
+int assetsReload();
+void assetsCollect();
+unsigned long assetsFrameCount();
+const unsigned char *assetsFrame(const char *name, const unsigned char *fallback);
+const LedMatrixAnimation *assetsAnimation(const char *name, const LedMatrixAnimation *fallback);
+
+#endif
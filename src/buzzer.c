@@ -1,60 +1,374 @@
 /*
 
-The buzzer is PWM controlled. We use softTone to handle the PWM.
+The buzzer is PWM controlled. When running as root, the buzzer pin is driven by the SoC's hardware
+PWM channel, so a tone costs no CPU and keeps a stable pitch (see buzzer_pwm.c for the tone math).
+Otherwise, we fall back to softTone, which bit-bangs the square wave from a thread of its own.
+
+Tunes are played by a sequencer thread, so none of the buzzer functions block the caller. A tune is
+a list of notes, each a tone held for a duration and followed by a silent gap. Notes are queued to
+the sequencer, which times every note from the end of the previous one so a tune never drifts.
+
+`buzPlayNotes` (and the tune helpers built on it) replaces whatever is playing, while `buzQueueNotes`
+appends to it. The queue grows to fit whatever is submitted, so a sequence of any length is voiced. `buzWait` waits for the queue to run dry, and `buzDoneFd` exposes the eventfd the
+sequencer signals when it does.
 
 */
 
 #include <wiringPi.h>
 #include <softTone.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "buzzer.h"
+#include "buzzer_pwm.h"
+#include "clock.h"
+#include "stats.h"
+#include "trace.h"
 
 #define BUZZER 26
 
+// How many notes the queue holds to begin with. Must be a power of two, as the queue grows by doubling.
+#define NOTE_QUEUE_SIZE 64
+
+// How late a note may start and still be timed from the end of the previous one.
+#define NOTE_SLACK_NS 2000000ULL
+
+static int isPwmPin(int pin);
+static void writeTone(int tone);
+static void *sequence(void *arg);
+static int queueNotes(const BuzNote *notes, int count);
+static void growQueue(unsigned int needed);
+static void notify(int fd);
+
+static const BuzNote COUNTDOWN_NOTES[] = {
+    {784, 120, 480},
+    {784, 120, 480},
+    {784, 480, 0},
+};
+
+static const BuzNote SUCCESS_NOTES[] = {
+    {659, 220, 0},
+    {523, 220, 0},
+    {784, 300, 0},
+};
+
+static const BuzNote INCORRECT_NOTES[] = {
+    {120, 220, 220},
+    {120, 220, 220},
+    {120, 220, 220},
+};
+
+// Notes waiting to be played, and whether the note being played should be cut short.
+//
+// Safety: The queue is shared by every thread submitting notes and the sequencer thread, and is
+// only touched with `queueLock` held.
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static BuzNote *noteQueue = NULL;
+static unsigned int queueSize = 0;
+static unsigned int noteHead = 0;
+static unsigned int noteTail = 0;
+static int cancelled = 0;
+
+// Set when the tone is driven by the hardware PWM channel instead of softTone, and the registers
+// last written to it.
+static int hardwarePwm = 0;
+static BuzPwmRegisters pwmRegs;
+
+// Whether a tone is sounding, so the trace shows each tone as one span.
+static int sounding = 0;
+
+// Wakes the sequencer when notes are submitted or cancelled.
+static int wakeFd = -1;
+
+// Signalled whenever the sequencer runs out of notes.
+static int doneFd = -1;
+
+// Every submission bumps `submitted`. Once the sequencer has nothing left to play, it sets
+// `finished` to the submissions it has seen, so `finished < submitted` while anything is pending.
+static unsigned long submitted = 0;
+static atomic_ulong finished = 0;
+
 // Initialize the buzzer peripheral.
 void buzInit()
 {
-    softToneCreate(BUZZER);
+    // The PWM registers can only be reached as root.
+    if (geteuid() == 0 && isPwmPin(BUZZER))
+    {
+        hardwarePwm = 1;
+        buzPwmInit(&pwmRegs);
+
+        pinMode(BUZZER, PWM_OUTPUT);
+        pwmSetMode(PWM_MODE_MS);
+        pwmSetClock(pwmRegs.divisor);
+        pwmSetRange(pwmRegs.range);
+        pwmWrite(BUZZER, 0);
+    }
+    else
+    {
+        printf("Buzzer: hardware PWM unavailable, using softTone\n");
+        softToneCreate(BUZZER);
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Start the buzzer sequencer thread.
+    pthread_t sequencer_thread;
+    pthread_create(&sequencer_thread, NULL, sequence, NULL);
+}
+
+// Plays a list of notes, replacing whatever is playing. Returns immediately.
+// Returns the number of notes queued, which is less than `count` only if the queue could not grow.
+int buzPlayNotes(const BuzNote *notes, int count)
+{
+    pthread_mutex_lock(&queueLock);
+    noteHead = noteTail;
+    cancelled = 1;
+    int queued = queueNotes(notes, count);
+    pthread_mutex_unlock(&queueLock);
+
+    return queued;
+}
+
+// Plays a list of notes after whatever is playing. Returns immediately.
+// Returns the number of notes queued, which is less than `count` only if the queue could not grow.
+int buzQueueNotes(const BuzNote *notes, int count)
+{
+    pthread_mutex_lock(&queueLock);
+    int queued = queueNotes(notes, count);
+    pthread_mutex_unlock(&queueLock);
+
+    return queued;
+}
+
+// Silences the buzzer and drops every queued note.
+void buzCancel()
+{
+    buzPlayNotes(NULL, 0);
+}
+
+// Pauses the thread until every submitted note has been played or cancelled.
+void buzWait()
+{
+    pthread_mutex_lock(&queueLock);
+    unsigned long target = submitted;
+    pthread_mutex_unlock(&queueLock);
+
+    struct pollfd fd = {.fd = doneFd, .events = POLLIN};
+
+    while (atomic_load_explicit(&finished, memory_order_acquire) < target)
+    {
+        uint64_t count;
+        clockPoll(&fd, 1, -1);
+        if (read(doneFd, &count, sizeof(count)) == -1)
+            continue;
+    }
+}
+
+// Returns 1 if every submitted note has been played or cancelled, or 0 if any are pending.
+int buzDone()
+{
+    pthread_mutex_lock(&queueLock);
+    unsigned long target = submitted;
+    pthread_mutex_unlock(&queueLock);
+
+    return atomic_load_explicit(&finished, memory_order_acquire) >= target;
+}
+
+// Returns the eventfd signalled whenever the sequencer runs out of notes.
+int buzDoneFd()
+{
+    return doneFd;
 }
 
 void buzPlay(int tone, int duration)
 {
-    softToneWrite(BUZZER, tone);
-    delay(duration);
-    softToneWrite(BUZZER, 0);
+    BuzNote note = {tone, duration, 0};
+    buzPlayNotes(&note, 1);
 }
 
 void buzPlayCountdown()
 {
-    softToneWrite(BUZZER, 784);
-    delay(120);
-    softToneWrite(BUZZER, 0);
-    delay(480);
-    softToneWrite(BUZZER, 784);
-    delay(120);
-    softToneWrite(BUZZER, 0);
-    delay(480);
-    softToneWrite(BUZZER, 784);
-    delay(480);
-    softToneWrite(BUZZER, 0);
+    buzPlayNotes(COUNTDOWN_NOTES, sizeof(COUNTDOWN_NOTES) / sizeof(BuzNote));
 }
 
 void buzPlaySuccess()
 {
-    softToneWrite(BUZZER, 659);
-    delay(220);
-    softToneWrite(BUZZER, 523);
-    delay(220);
-    softToneWrite(BUZZER, 784);
-    delay(300);
-    softToneWrite(BUZZER, 0);
+    buzPlayNotes(SUCCESS_NOTES, sizeof(SUCCESS_NOTES) / sizeof(BuzNote));
 }
 
 void buzPlayIncorrect()
 {
-    for (int i = 0; i < 3; i++)
+    buzPlayNotes(INCORRECT_NOTES, sizeof(INCORRECT_NOTES) / sizeof(BuzNote));
+}
+
+// Returns whether a wiringPi pin is wired to a hardware PWM channel.
+static int isPwmPin(int pin)
+{
+    return pin == 1 || pin == 23 || pin == 24 || pin == 26;
+}
+
+// Plays `tone` Hz on the buzzer, or silences it if `tone` is 0.
+static void writeTone(int tone)
+{
+    if (tone && !sounding)
+        traceBegin("buzzer.tone", tone);
+    else if (!tone && sounding)
+        traceEnd("buzzer.tone", 0);
+    sounding = tone != 0;
+
+    if (!hardwarePwm)
+    {
+        softToneWrite(BUZZER, tone);
+        return;
+    }
+
+    // The range register is shared by both channels, so only write it when the period changes.
+    unsigned int range = pwmRegs.range;
+    buzPwmSetTone(&pwmRegs, tone);
+    if (pwmRegs.range != range)
+        pwmSetRange(pwmRegs.range);
+    pwmWrite(BUZZER, pwmRegs.data);
+}
+
+// Appends notes to the queue, growing it if they do not fit, and wakes the sequencer. `queueLock`
+// must be held.
+static int queueNotes(const BuzNote *notes, int count)
+{
+    if (noteHead - noteTail + count > queueSize)
+        growQueue(noteHead - noteTail + count);
+
+    int queued = 0;
+    while (queued < count && noteHead - noteTail < queueSize)
+        noteQueue[noteHead++ % queueSize] = notes[queued++];
+
+    submitted++;
+    notify(wakeFd);
+
+    return queued;
+}
+
+// Doubles the queue until it holds `needed` notes, keeping the queued ones in order. The queue keeps
+// its old size if memory runs out. `queueLock` must be held.
+static void growQueue(unsigned int needed)
+{
+    unsigned int size = queueSize ? queueSize : NOTE_QUEUE_SIZE;
+    while (size < needed)
+        size *= 2;
+
+    BuzNote *queue = malloc(size * sizeof(BuzNote));
+    if (!queue)
+    {
+        printf("Out of memory for the buzzer queue\n");
+        return;
+    }
+
+    unsigned int pending = noteHead - noteTail;
+    for (unsigned int i = 0; i < pending; i++)
+        queue[i] = noteQueue[(noteTail + i) % queueSize];
+
+    free(noteQueue);
+    noteQueue = queue;
+    queueSize = size;
+    noteTail = 0;
+    noteHead = pending;
+}
+
+// Plays queued notes until the queue runs dry, then waits for more.
+static void *sequence(void *arg)
+{
+    // The note being played, when its current step (the tone, then the gap) ends, and whether
+    // the tone has already been silenced for the gap.
+    traceThread("buzzer");
+
+    BuzNote note = {0};
+    uint64_t stepEnd = 0;
+    int playing = 0;
+    int inGap = 0;
+
+    struct pollfd fd = {.fd = wakeFd, .events = POLLIN};
+
+    while (1)
     {
-        softToneWrite(BUZZER, 120);
-        delay(220);
-        softToneWrite(BUZZER, 0);
-        delay(220);
+        int64_t waitNs = -1;
+        if (playing)
+        {
+            uint64_t now = clockNowNs();
+            waitNs = now >= stepEnd ? 0 : stepEnd - now;
+        }
+
+        uint64_t count;
+        if (clockPoll(&fd, 1, waitNs) > 0 && read(wakeFd, &count, sizeof(count)) == -1)
+            continue;
+
+        pthread_mutex_lock(&queueLock);
+
+        uint64_t now = clockNowNs();
+
+        if (cancelled)
+        {
+            cancelled = 0;
+            if (playing)
+                writeTone(0);
+            playing = 0;
+            stepEnd = now;
+        }
+
+        // Finish the current step. Steps are timed from the end of the previous one, so a tune
+        // keeps its tempo however late this thread wakes.
+        if (playing && now >= stepEnd)
+        {
+            if (!inGap)
+                writeTone(0);
+
+            if (!inGap && note.gapMs)
+            {
+                inGap = 1;
+                stepEnd += note.gapMs * 1000000ULL;
+            }
+            else
+            {
+                playing = 0;
+            }
+        }
+
+        // Start the next note, if the current one is done.
+        if (!playing && noteTail != noteHead)
+        {
+            note = noteQueue[noteTail++ % queueSize];
+            writeTone(note.tone);
+            statsAdd(STATS_BUZZER_NOTES, 1);
+
+            // Back-to-back notes follow on exactly, anything else starts now.
+            if (stepEnd + NOTE_SLACK_NS < now)
+                stepEnd = now;
+            stepEnd += note.durationMs * 1000000ULL;
+            playing = 1;
+            inGap = 0;
+        }
+
+        if (!playing && atomic_load_explicit(&finished, memory_order_relaxed) != submitted)
+        {
+            atomic_store_explicit(&finished, submitted, memory_order_release);
+            notify(doneFd);
+        }
+
+        pthread_mutex_unlock(&queueLock);
     }
-}
\ No newline at end of file
+
+    return NULL;
+}
+
+// Signals an eventfd.
+static void notify(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) == -1)
+        return;
+}
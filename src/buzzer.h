@@ -1,10 +1,24 @@
 #ifndef BUZZER_H
 #define BUZZER_H
 
+// A tone in Hz (0 for silence) held for `durationMs`, followed by `gapMs` of silence.
+typedef struct
+{
+    unsigned short tone;
+    unsigned short durationMs;
+    unsigned short gapMs;
+} BuzNote;
+
 void buzInit();
+int buzPlayNotes(const BuzNote *notes, int count);
+int buzQueueNotes(const BuzNote *notes, int count);
+void buzCancel();
+void buzWait();
+int buzDone();
+int buzDoneFd();
 void buzPlay(int tone, int duration);
 void buzPlayCountdown();
 void buzPlaySuccess();
 void buzPlayIncorrect();
 
-#endif
\ No newline at end of file
+#endif
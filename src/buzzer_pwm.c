@@ -0,0 +1,62 @@
+/*
+
+Tone math for the hardware PWM buzzer backend.
+
+The PWM channel runs in mark-space mode from a fixed clock divisor, so the counter ticks at a
+constant rate. A tone sets the range (the period, in counts) to the counter rate over the tone's
+frequency, and the data (the high time) to half of it, giving a square wave. Silence is data 0,
+which holds the output low.
+
+*/
+
+#include "buzzer_pwm.h"
+
+// The shortest period the channel can produce a square wave with.
+#define MIN_RANGE 2
+
+// Resets the registers to a silent channel.
+void buzPwmInit(BuzPwmRegisters *regs)
+{
+    regs->divisor = BUZ_PWM_DIVISOR;
+    regs->range = 1024;
+    regs->data = 0;
+}
+
+// Sets the registers up to play `tone` Hz, or silence if `tone` is 0 or less.
+// The range is left alone on silence, so the next tone only changes what it has to.
+void buzPwmSetTone(BuzPwmRegisters *regs, int tone)
+{
+    if (tone <= 0)
+    {
+        regs->data = 0;
+        return;
+    }
+
+    // Round to the nearest period, which keeps the error under half a count.
+    unsigned int counterHz = BUZ_PWM_BASE_CLOCK / regs->divisor;
+    unsigned int range = (counterHz + tone / 2) / tone;
+    if (range < MIN_RANGE)
+        range = MIN_RANGE;
+
+    regs->range = range;
+    regs->data = range / 2;
+}
+
+// Returns the frequency the registers produce, in Hz, or 0 if the channel is silent.
+unsigned int buzPwmFrequency(const BuzPwmRegisters *regs)
+{
+    if (!regs->data || !regs->range)
+        return 0;
+
+    unsigned int counterHz = BUZ_PWM_BASE_CLOCK / regs->divisor;
+    return (counterHz + regs->range / 2) / regs->range;
+}
+
+// Returns the fraction of each period the output is high, in thousandths.
+unsigned int buzPwmDutyPermille(const BuzPwmRegisters *regs)
+{
+    if (!regs->range)
+        return 0;
+
+    return regs->data * 1000 / regs->range;
+}
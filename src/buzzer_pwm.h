@@ -0,0 +1,24 @@
+#ifndef BUZZER_PWM_H
+#define BUZZER_PWM_H
+
+// The PWM clock before the divisor. wiringPi scales the divisor on boards with a different clock.
+#define BUZ_PWM_BASE_CLOCK 19200000
+
+// The fixed PWM clock divisor, giving a 600 kHz counter.
+#define BUZ_PWM_DIVISOR 32
+
+// The registers of a PWM channel in mark-space mode. The output is high for `data` counts out of
+// every `range` counts. Has no hardware dependencies, so the tone math can be checked anywhere.
+typedef struct
+{
+    unsigned int divisor;
+    unsigned int range;
+    unsigned int data;
+} BuzPwmRegisters;
+
+void buzPwmInit(BuzPwmRegisters *regs);
+void buzPwmSetTone(BuzPwmRegisters *regs, int tone);
+unsigned int buzPwmFrequency(const BuzPwmRegisters *regs);
+unsigned int buzPwmDutyPermille(const BuzPwmRegisters *regs);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+
+Monotonic time helpers shared by the driver threads.
+
+Threads that run on a fixed rate keep an absolute deadline and sleep until it, instead of sleeping
+for a relative amount of time. That way the time spent working does not add up into drift.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "clock.h"
+
+// Returns the current monotonic time in nanoseconds.
+uint64_t clockNowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Sleeps the calling thread until the monotonic clock reaches `deadline` (in nanoseconds).
+// Returns at once if the deadline has already passed.
+void clockSleepUntilNs(uint64_t deadline)
+{
+    if (deadline <= clockNowNs())
+        return;
+
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+// Waits until the monotonic clock reaches `deadline`, sleeping until `spinNs` before it and
+// spinning for the rest. Sleeps can wake up tens of microseconds late, which is too coarse for
+// short waits.
+void clockWaitUntilNs(uint64_t deadline, uint64_t spinNs)
+{
+    if (deadline > clockNowNs() + spinNs)
+        clockSleepUntilNs(deadline - spinNs);
+
+    while (clockNowNs() < deadline)
+        ;
+}
+
+// Polls `fds` like poll(), waiting up to `timeoutNs`, or forever if negative.
+int clockPoll(struct pollfd *fds, int count, int64_t timeoutNs)
+{
+    if (timeoutNs < 0)
+        return ppoll(fds, count, NULL, NULL);
+
+    struct timespec ts;
+    ts.tv_sec = timeoutNs / 1000000000LL;
+    ts.tv_nsec = timeoutNs % 1000000000LL;
+    return ppoll(fds, count, &ts, NULL);
+}
@@ -0,0 +1,12 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <poll.h>
+
+uint64_t clockNowNs();
+void clockSleepUntilNs(uint64_t deadline);
+void clockWaitUntilNs(uint64_t deadline, uint64_t spinNs);
+int clockPoll(struct pollfd *fds, int count, int64_t timeoutNs);
+
+#endif
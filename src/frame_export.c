@@ -0,0 +1,117 @@
+/*
+
+Publishes what the matrix shows into a POSIX shared-memory ring (see frame_export_format.h), so
+local viewers and recorders can follow the display without touching the render thread.
+
+The render thread commits the frame it is about to scan. Only frames that differ from the last one
+committed are written, so a still picture costs a comparison per scan, and a new frame costs a slot's
+sequence, its timestamps and the bit-plane words of the panels in use (8 words a panel), plus the
+ring's head. Nothing is ever waited on: readers that fall a whole ring behind lose frames, and a
+reader that copied a slot while it was being rewritten sees its sequence change and drops the copy.
+
+Readers map the ring read-only and copy frames straight out of it.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frame_export.h"
+#include "frame_export_format.h"
+
+_Static_assert(sizeof(LedMatrixFrame) == FRAME_EXPORT_PANEL_SIZE, "exported panels must match LedMatrixFrame");
+_Static_assert(LED_MATRIX_MAX_PANELS <= FRAME_EXPORT_MAX_PANELS, "every panel must fit in an exported frame");
+
+// The mapped ring, or NULL when frames are not exported.
+static FrameExport *ring = NULL;
+
+// The last frame committed. Only used by the render thread.
+static LedMatrixFramebuffer lastFrame;
+static int lastPanels = 0;
+
+// Creates (or reuses) the shared-memory object `name`, which must start with a `/`, and starts
+// exporting frames into it. Must be called before `ledMatrixInit`, after the layout is set.
+// Returns 0 on success, or -1 if the ring could not be set up.
+int frameExportInit(const char *name)
+{
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd == -1)
+    {
+        perror("Failed to open frame export");
+        return -1;
+    }
+
+    // A ring left behind by a previous run is only ever grown, never truncated: a viewer may still
+    // have it mapped, and would fault on the pages a truncate took away. It is reset below instead.
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (info.st_size < (off_t)sizeof(FrameExport) && ftruncate(fd, sizeof(FrameExport)) == -1))
+    {
+        perror("Failed to size frame export");
+        close(fd);
+        return -1;
+    }
+
+    FrameExport *map = mmap(NULL, sizeof(FrameExport), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("Failed to map frame export");
+        return -1;
+    }
+
+    // Hide an old ring from new readers while it is reset. Its slots are emptied before the head
+    // starts over, so viewers still following it see the game restart and wait for frame 0.
+    memset(map->header.magic, 0, sizeof(map->header.magic));
+    for (int i = 0; i < FRAME_EXPORT_SLOTS; i++)
+        atomic_store_explicit(&map->slots[i].sequence, 0, memory_order_relaxed);
+    atomic_store_explicit(&map->header.head, 0, memory_order_release);
+
+    map->header.version = FRAME_EXPORT_VERSION;
+    map->header.slotCount = FRAME_EXPORT_SLOTS;
+    map->header.bits = FRAME_EXPORT_BITS;
+    map->header.panelsWide = ledMatrixWidth() / SIZE;
+    map->header.panelsHigh = ledMatrixHeight() / SIZE;
+
+    // Readers check the magic first, so it goes in last.
+    atomic_thread_fence(memory_order_release);
+    memcpy(map->header.magic, FRAME_EXPORT_MAGIC, sizeof(map->header.magic));
+
+    ring = map;
+    return 0;
+}
+
+// Writes the frame about to be scanned into the ring, unless it is the one last written.
+// Only called by the render thread; does nothing when frames are not exported.
+void frameExportCommit(const LedMatrixFramebuffer *framebuffer, int panels, uint64_t timeNs, unsigned long generation)
+{
+    if (!ring)
+        return;
+
+    size_t bytes = panels * sizeof(LedMatrixFrame);
+    if (panels == lastPanels && memcmp(framebuffer->panels, lastFrame.panels, bytes) == 0)
+        return;
+
+    memcpy(lastFrame.panels, framebuffer->panels, bytes);
+    lastPanels = panels;
+
+    uint32_t words[FRAME_EXPORT_WORDS];
+    memcpy(words, framebuffer->panels, bytes);
+
+    uint64_t index = atomic_load_explicit(&ring->header.head, memory_order_relaxed);
+    FrameExportSlot *slot = &ring->slots[index % FRAME_EXPORT_SLOTS];
+
+    atomic_store_explicit(&slot->sequence, index * 2 + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->timeNs, timeNs, memory_order_relaxed);
+    atomic_store_explicit(&slot->generation, generation, memory_order_relaxed);
+    for (size_t i = 0; i < bytes / sizeof(uint32_t); i++)
+        atomic_store_explicit(&slot->words[i], words[i], memory_order_relaxed);
+
+    atomic_store_explicit(&slot->sequence, index * 2 + 2, memory_order_release);
+    atomic_store_explicit(&ring->header.head, index + 1, memory_order_release);
+}
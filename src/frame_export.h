@@ -0,0 +1,11 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <stdint.h>
+
+#include "led_matrix.h"
+
+int frameExportInit(const char *name);
+void frameExportCommit(const LedMatrixFramebuffer *framebuffer, int panels, uint64_t timeNs, unsigned long generation);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef FRAME_EXPORT_FORMAT_H
+#define FRAME_EXPORT_FORMAT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+// The layout of the shared-memory frame ring, shared by the game (frame_export.c) and its readers
+// (tools/frame_view.c).
+//
+// The ring holds the last FRAME_EXPORT_SLOTS frames the matrix showed. There is one writer, the
+// render thread, and any number of readers that map the ring read-only. Frame `n` lives in slot
+// `n % FRAME_EXPORT_SLOTS`, and `head` counts the frames written so far. Each slot is a seqlock:
+// its sequence is odd while frame `n` is being written and `2n + 2` once it is complete, so a reader
+// knows both whether a copy is torn and whether the slot still holds the frame it wanted.
+
+#define FRAME_EXPORT_MAGIC "MGFB"
+#define FRAME_EXPORT_VERSION 1
+
+// How many frames the ring keeps. Must be a power of two.
+#define FRAME_EXPORT_SLOTS 256
+
+#define FRAME_EXPORT_MAX_PANELS 8
+#define FRAME_EXPORT_BITS 4
+
+// A panel's frame is its bit-planes one after the other, each one byte per row like the `_BITS`
+// frames: the byte of plane `b` and row `r` is at `b * 8 + r`.
+#define FRAME_EXPORT_PANEL_SIZE (FRAME_EXPORT_BITS * 8)
+#define FRAME_EXPORT_WORDS (FRAME_EXPORT_MAX_PANELS * FRAME_EXPORT_PANEL_SIZE / 4)
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t bits;
+    uint32_t panelsWide;
+    uint32_t panelsHigh;
+    uint64_t reserved;
+    _Atomic uint64_t head;
+} FrameExportHeader;
+
+typedef struct
+{
+    _Atomic uint64_t sequence;
+    _Atomic uint64_t timeNs;
+    _Atomic uint64_t generation;
+    _Atomic uint32_t words[FRAME_EXPORT_WORDS];
+} FrameExportSlot;
+
+typedef struct
+{
+    FrameExportHeader header;
+    FrameExportSlot slots[FRAME_EXPORT_SLOTS];
+} FrameExport;
+
+// A frame copied out of the ring.
+typedef struct
+{
+    uint64_t timeNs;
+    uint64_t generation;
+    unsigned char panels[FRAME_EXPORT_MAX_PANELS][FRAME_EXPORT_PANEL_SIZE];
+} FrameExportFrame;
+
+// Copies frame `index` out of the ring into `frame`.
+// Returns 1 on success, 0 if the frame has not been written yet, or -1 if it has been overwritten.
+static inline int frameExportRead(const FrameExport *ring, uint64_t index, FrameExportFrame *frame)
+{
+    const FrameExportSlot *slot = &ring->slots[index % FRAME_EXPORT_SLOTS];
+    uint64_t complete = index * 2 + 2;
+
+    uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (before < complete)
+        return 0;
+    if (before != complete)
+        return -1;
+
+    uint32_t words[FRAME_EXPORT_WORDS];
+    for (int i = 0; i < FRAME_EXPORT_WORDS; i++)
+        words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+    frame->timeNs = atomic_load_explicit(&slot->timeNs, memory_order_relaxed);
+    frame->generation = atomic_load_explicit(&slot->generation, memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != before)
+        return -1;
+
+    memcpy(frame->panels, words, sizeof(words));
+    return 1;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+
+An optional fast path for the bit-banged drivers, which maps the GPIO registers into memory.
+
+wiringPi costs a library call and a pin lookup for every `digitalWrite`. With the registers mapped,
+a pin change is a single store to the set or clear register, and a data bit and clock edge can
+often share one store.
+
+The mapping can either be `/dev/gpiomem` on the Pi, or a plain file on a dev box. A file acts as a
+fake register block: writes are folded into the level register, and every resulting pin level is
+appended to a trace after the register block, so the output can be checked bit for bit.
+
+*/
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gpio.h"
+
+// The size of the GPIO register block.
+#define GPIO_BLOCK_SIZE 4096
+
+// The number of pin levels a fake register block can trace before wrapping around.
+#define FAKE_TRACE_LEVELS (1 << 20)
+
+// The mapped registers, or NULL when the fast path is disabled.
+volatile uint32_t *gpioRegs = NULL;
+
+// Whether the mapped registers are a fake register block.
+int gpioFake = 0;
+
+// wiringPi pin numbers to BCM GPIO numbers, for the Pi 2 and newer.
+const unsigned char gpioWpiToBcm[32] = {
+    17, 18, 27, 22, 23, 24, 25, 4,
+    2, 3, 8, 7, 10, 9, 11, 14,
+    15, 28, 29, 30, 31, 5, 6, 13,
+    19, 26, 12, 16, 20, 21, 0, 1};
+
+// The trace of a fake register block. The first word counts the levels written so far.
+static atomic_uint *fakeTrace = NULL;
+
+// Maps the GPIO registers at `path`, enabling the fast path.
+// Returns 0 on success, or -1 if the registers could not be mapped.
+int gpioFastInit(const char *path)
+{
+    int fd = open(path, O_RDWR | O_SYNC);
+    if (fd == -1)
+    {
+        perror("Failed to open GPIO registers");
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        perror("Failed to stat GPIO registers");
+        close(fd);
+        return -1;
+    }
+    int fake = S_ISREG(info.st_mode);
+
+    size_t size = GPIO_BLOCK_SIZE;
+    if (fake)
+    {
+        size += (FAKE_TRACE_LEVELS + 1) * sizeof(uint32_t);
+        if (info.st_size < (off_t)size && ftruncate(fd, size) == -1)
+        {
+            perror("Failed to size fake GPIO registers");
+            close(fd);
+            return -1;
+        }
+    }
+
+    void *regs = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (regs == MAP_FAILED)
+    {
+        perror("Failed to map GPIO registers");
+        return -1;
+    }
+
+    if (fake)
+        fakeTrace = (atomic_uint *)((char *)regs + GPIO_BLOCK_SIZE);
+
+    gpioFake = fake;
+    gpioRegs = regs;
+
+    printf("GPIO fast path enabled (%s)\n", fake ? "fake register block" : path);
+    return 0;
+}
+
+// Applies a write to the fake register block, and traces the resulting pin levels.
+void gpioFakeWrite(uint32_t set, uint32_t clear)
+{
+    atomic_uint *level = (atomic_uint *)&gpioRegs[GPIO_GPLEV0];
+
+    gpioRegs[GPIO_GPSET0] = set;
+    gpioRegs[GPIO_GPCLR0] = clear;
+
+    atomic_fetch_and(level, ~clear);
+    uint32_t levels = atomic_fetch_or(level, set) | set;
+
+    unsigned int index = atomic_fetch_add(&fakeTrace[0], 1);
+    atomic_store_explicit(&fakeTrace[1 + index % FAKE_TRACE_LEVELS], levels, memory_order_relaxed);
+}
+
+// Returns how many writes the fake register block has traced, wrapping around, or 0 for real registers.
+unsigned int gpioFakeWriteCount()
+{
+    return fakeTrace ? atomic_load(&fakeTrace[0]) : 0;
+}
@@ -0,0 +1,110 @@
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <stdint.h>
+#include <wiringPi.h>
+#include <wiringShift.h>
+
+// Word offsets of the registers we use in the GPIO register block.
+#define GPIO_GPSET0 (0x1C / 4)
+#define GPIO_GPCLR0 (0x28 / 4)
+#define GPIO_GPLEV0 (0x34 / 4)
+
+extern volatile uint32_t *gpioRegs;
+extern int gpioFake;
+extern const unsigned char gpioWpiToBcm[32];
+
+int gpioFastInit(const char *path);
+void gpioFakeWrite(uint32_t set, uint32_t clear);
+unsigned int gpioFakeWriteCount();
+
+// Returns the register mask of a wiringPi pin.
+static inline uint32_t gpioPinMask(int pin)
+{
+    return 1u << gpioWpiToBcm[pin & 31];
+}
+
+// Sets the pins in `set` high and the pins in `clear` low.
+static inline void gpioWrite(uint32_t set, uint32_t clear)
+{
+    if (gpioFake)
+    {
+        gpioFakeWrite(set, clear);
+        return;
+    }
+
+    if (clear)
+        gpioRegs[GPIO_GPCLR0] = clear;
+    if (set)
+        gpioRegs[GPIO_GPSET0] = set;
+}
+
+// Waits until earlier register stores have reached the pins. Stores to the peripheral can be
+// buffered, but a read of the level register cannot complete before them, so whatever is written
+// after it follows them on the pins. Does nothing without real mapped registers.
+static inline void gpioSettle()
+{
+    if (gpioRegs && !gpioFake)
+        (void)gpioRegs[GPIO_GPLEV0];
+}
+
+// Writes a pin, through the mapped registers when the fast path is enabled.
+static inline void gpioDigitalWrite(int pin, int value)
+{
+    if (!gpioRegs)
+    {
+        digitalWrite(pin, value);
+        return;
+    }
+
+    uint32_t mask = gpioPinMask(pin);
+    if (value)
+        gpioWrite(mask, 0);
+    else
+        gpioWrite(0, mask);
+}
+
+// Reads a pin, through the mapped registers when the fast path is enabled.
+static inline int gpioDigitalRead(int pin)
+{
+    if (!gpioRegs)
+        return digitalRead(pin);
+
+    return (gpioRegs[GPIO_GPLEV0] & gpioPinMask(pin)) ? HIGH : LOW;
+}
+
+// Shifts a byte out MSB first, through the mapped registers when the fast path is enabled.
+// Produces the same edges as wiringPi's shiftOut: data is set up, then the clock pulses high and low.
+// Each data bit is read back before the rising edge, so it is set up on the pin when the edge comes.
+static inline void gpioShiftOut(int dataPin, int clkPin, unsigned char byte)
+{
+    if (!gpioRegs)
+    {
+        shiftOut(dataPin, clkPin, MSBFIRST, byte);
+        return;
+    }
+
+    uint32_t data = gpioPinMask(dataPin);
+    uint32_t clk = gpioPinMask(clkPin);
+
+    for (int i = 7; i >= 0; i--)
+    {
+        // The previous falling clock edge and a low data bit share a single clear store.
+        if (byte & (1 << i))
+        {
+            gpioWrite(0, clk);
+            gpioWrite(data, 0);
+        }
+        else
+        {
+            gpioWrite(0, clk | data);
+        }
+
+        gpioSettle();
+        gpioWrite(clk, 0);
+    }
+
+    gpioWrite(0, clk);
+}
+
+#endif
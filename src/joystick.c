@@ -6,179 +6,479 @@ Instead, we must use the provided ADC module (ADC0832) and poll the ADC for inpu
 The ADC0832 starts a transaction when CS pin is pulled low, a start bit, mode bit, and channel bit are sent.
 Bits are only read from the DATA pin on rising edges (low -> high)
 
+The ADC is clocked at 250 kHz, inside its rated range. Bits sent to it are set up on DATA half a clock
+before the rising edge, and CS stays high for half a clock between transactions, so the timing holds
+even when the pins are driven through the GPIO fast path. Every sample is sent twice, MSB first and
+then LSB first, and samples whose two copies disagree are rejected.
+
+Polling happens on a sampler thread at a fixed rate. Each sample of both channels and the button is
+kept in a ring buffer, and decoded into timestamped direction, center and button events that are
+queued for the game thread. Waiting for input is then just waiting on the queue.
+
+Before sampling starts, the rest point and noise of each axis are measured, and the decoder's
+thresholds are derived from them (see joystick_decoder.c). The stick must not be touched while
+`joystickInit` runs.
+
 */
 
 #include <wiringPi.h>
+#include <stdio.h>
 #include <stdlib.h>
-
-#define DATA 27
-#define CLK 28
-#define CS 29
-
-// The pin for the joystick zed button.
-#define JOYSTICK_Z 22
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "clock.h"
+#include "gpio.h"
+#include "joystick.h"
+#include "joystick_decoder.h"
+#include "stats.h"
+#include "trace.h"
+
+// Pin definitions of the game's joystick: the ADC's data, clock and chip select, then the zed button.
+const JoystickPins JOYSTICK_PINS = {.data = 27, .clk = 28, .cs = 29, .button = 22};
 
 #define X_CHANNEL 0
 #define Y_CHANNEL 1
 
-const int JOY_LEFT = 0;
-const int JOY_RIGHT = 1;
-const int JOY_UP = 2;
-const int JOY_DOWN = 3;
+// Half of the ADC clock period, in microseconds.
+#define ADC_HALF_CLOCK_US 2
+
+// How often both channels are sampled.
+#define SAMPLE_HZ 500
+
+// How many samples the calibration pass takes.
+#define CALIBRATION_SAMPLES 100
+
+// Sizes of the sample ring buffer and the event queue. Both must be powers of two.
+#define SAMPLE_RING_SIZE 256
+#define EVENT_QUEUE_SIZE 64
+
+static int readByte(const JoystickPins *pins);
+static void sendBit(const JoystickPins *pins, int bit);
+static int readChannel(const JoystickPins *pins, int channel);
+static void calibrate();
+static void *sample(void *arg);
+static void decode(const JoystickSample *sample);
+static void pushEvent(JoystickEventType type, int dir, uint64_t timeNs);
+
+// The latest samples, written by the sampler thread.
+static JoystickSample sampleRing[SAMPLE_RING_SIZE];
+static atomic_ulong samplesWritten = 0;
+
+// Decoded events, from the sampler thread (producer) to the game thread (consumer).
+static JoystickEvent eventQueue[EVENT_QUEUE_SIZE];
+static atomic_uint eventHead = 0;
+static atomic_uint eventTail = 0;
+
+// Decodes samples into events. Only used by the sampler thread once it is started.
+static JoystickDecoder decoder;
+
+// Signalled whenever an event is queued.
+static int eventFd = -1;
+
+// The debounced stick and button state, as last decoded.
+static atomic_int stickCentered = 1;
+static atomic_int buttonDown = 0;
 
-static unsigned char readByte();
-static void sendBit(int bit);
-static unsigned char readChannel(int channel);
+// Statistics.
+static atomic_ulong eventsDropped = 0;
+static atomic_ulong missedFlicks = 0;
+static atomic_ulong adcRejects = 0;
+static atomic_uint latencyAvgUs = 0;
+static atomic_uint latencyMaxUs = 0;
 
 void joystickInit()
 {
-    pinMode(CS, OUTPUT);
-    pinMode(DATA, OUTPUT);
-    pinMode(CLK, OUTPUT);
+    joystickSetupPins(&JOYSTICK_PINS);
 
-    digitalWrite(CS, HIGH);
-    digitalWrite(DATA, LOW);
-    digitalWrite(CLK, LOW);
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    calibrate();
+
+    // Start the joystick sampler thread.
+    pthread_t sampler_thread;
+    pthread_create(&sampler_thread, NULL, sample, NULL);
 }
 
 // Check if the joystick Zed button axis is pushed down.
 int joystickZedDown()
 {
-    return !digitalRead(JOYSTICK_Z);
+    return atomic_load_explicit(&buttonDown, memory_order_relaxed);
 }
 
-// Pauses the thread and waits for a joystick direction, returning it.
-int joystickWaitForDir()
+// Takes the next event off the queue, waiting up to `timeoutMs` (or forever if negative) for one.
+// Returns 1 if an event was taken, or 0 on timeout.
+int joystickNextEvent(JoystickEvent *event, int timeoutMs)
 {
-    unsigned char lastXSample = 128;
-    unsigned char lastYSample = 128;
+    uint64_t deadline = clockNowNs() + (uint64_t)timeoutMs * 1000000ULL;
 
     while (1)
     {
-        unsigned char newXSample = readChannel(X_CHANNEL);
-        delay(25);
-        unsigned char newYSample = readChannel(Y_CHANNEL);
-        delay(25);
-
-        int xDiff = abs(lastXSample - newXSample);
-        int yDiff = abs(lastYSample - newYSample);
+        unsigned int tail = atomic_load_explicit(&eventTail, memory_order_relaxed);
+        if (tail != atomic_load_explicit(&eventHead, memory_order_acquire))
+        {
+            *event = eventQueue[tail % EVENT_QUEUE_SIZE];
+            atomic_store_explicit(&eventTail, tail + 1, memory_order_release);
+
+            // Track how long events wait between being sampled and being handled.
+            unsigned int latencyUs = (clockNowNs() - event->timeNs) / 1000;
+            statsRecord(STATS_JOYSTICK_LATENCY_US, latencyUs);
+            unsigned int avgUs = atomic_load_explicit(&latencyAvgUs, memory_order_relaxed);
+            atomic_store_explicit(&latencyAvgUs, avgUs - avgUs / 8 + latencyUs / 8, memory_order_relaxed);
+            if (latencyUs > atomic_load_explicit(&latencyMaxUs, memory_order_relaxed))
+                atomic_store_explicit(&latencyMaxUs, latencyUs, memory_order_relaxed);
+
+            return 1;
+        }
 
-        // Channel 0 (x) likes to jump to 255, so we ignore it.
-        if (xDiff <= 10 && newXSample != 255)
+        int64_t waitNs = -1;
+        if (timeoutMs >= 0)
         {
-            if (newXSample > 240)
-                return JOY_RIGHT;
-            else if (newXSample < 15)
-                return JOY_LEFT;
+            uint64_t now = clockNowNs();
+            if (now >= deadline)
+                return 0;
+
+            waitNs = deadline - now;
         }
 
-        if (yDiff <= 10)
+        struct pollfd fd = {.fd = eventFd, .events = POLLIN};
+        uint64_t count;
+        if (clockPoll(&fd, 1, waitNs) > 0 && read(eventFd, &count, sizeof(count)) == -1)
+            continue;
+    }
+}
+
+// Discards every queued event.
+void joystickFlushEvents()
+{
+    JoystickEvent event;
+    while (joystickNextEvent(&event, 0))
+        ;
+}
+
+// Returns the eventfd signalled whenever an event is queued.
+int joystickEventFd()
+{
+    return eventFd;
+}
+
+// Pauses the thread and waits up to `timeoutMs` (or forever if negative) for a joystick direction.
+// Returns the direction, or -1 on timeout.
+int joystickWaitForDirTimeout(int timeoutMs)
+{
+    uint64_t deadline = clockNowNs() + (uint64_t)timeoutMs * 1000000ULL;
+    JoystickEvent event;
+
+    while (1)
+    {
+        int waitMs = timeoutMs;
+        if (timeoutMs >= 0)
         {
-            if (newYSample > 240)
-                return JOY_UP;
-            else if (newYSample < 15)
-                return JOY_DOWN;
+            uint64_t now = clockNowNs();
+            waitMs = now >= deadline ? 0 : (deadline - now + 999999) / 1000000;
         }
 
-        lastXSample = newXSample;
-        lastYSample = newYSample;
+        if (!joystickNextEvent(&event, waitMs))
+            return -1;
+
+        if (event.type == JOY_EVENT_DIR)
+            return event.dir;
     }
 }
 
+// Pauses the thread and waits for a joystick direction, returning it.
+int joystickWaitForDir()
+{
+    return joystickWaitForDirTimeout(-1);
+}
+
 // Pauses the thread until the joystick is centered.
 void joystickWaitForCenter()
 {
-    unsigned char lastXSample = 0;
-    unsigned char lastYSample = 0;
+    JoystickEvent event;
+
+    while (!atomic_load_explicit(&stickCentered, memory_order_acquire))
+        joystickNextEvent(&event, 100);
+}
+
+// Copies up to `max` samples taken since `*cursor` into `out`, oldest first, and advances the cursor.
+// Samples that were overwritten before they could be copied are skipped.
+int joystickReadSamples(JoystickSample *out, int max, unsigned long *cursor)
+{
+    unsigned long written = atomic_load_explicit(&samplesWritten, memory_order_acquire);
+    if (written - *cursor > SAMPLE_RING_SIZE)
+        *cursor = written - SAMPLE_RING_SIZE;
+
+    unsigned long first = *cursor;
+    int count = 0;
+    while (*cursor < written && count < max)
+        out[count++] = sampleRing[(*cursor)++ % SAMPLE_RING_SIZE];
+
+    // Drop whatever the sampler may have overwritten while we were copying.
+    atomic_thread_fence(memory_order_acquire);
+    unsigned long after = atomic_load_explicit(&samplesWritten, memory_order_relaxed);
+    if (after - first > SAMPLE_RING_SIZE)
+    {
+        int overwritten = after - first - SAMPLE_RING_SIZE;
+        if (overwritten > count)
+            overwritten = count;
+
+        for (int i = overwritten; i < count; i++)
+            out[i - overwritten] = out[i];
+        count -= overwritten;
+    }
+
+    return count;
+}
+
+// Fills `stats` with the sampler's current statistics.
+void joystickGetStats(JoystickStats *stats)
+{
+    stats->samples = atomic_load_explicit(&samplesWritten, memory_order_relaxed);
+    stats->eventsDropped = atomic_load_explicit(&eventsDropped, memory_order_relaxed);
+    stats->missedFlicks = atomic_load_explicit(&missedFlicks, memory_order_relaxed);
+    stats->adcRejects = atomic_load_explicit(&adcRejects, memory_order_relaxed);
+    stats->latencyAvgUs = atomic_load_explicit(&latencyAvgUs, memory_order_relaxed);
+    stats->latencyMaxUs = atomic_load_explicit(&latencyMaxUs, memory_order_relaxed);
+}
+
+// Sets up the pins of a joystick's ADC and button, and leaves the ADC deselected.
+void joystickSetupPins(const JoystickPins *pins)
+{
+    pinMode(pins->cs, OUTPUT);
+    pinMode(pins->data, OUTPUT);
+    pinMode(pins->clk, OUTPUT);
+
+    digitalWrite(pins->cs, HIGH);
+    digitalWrite(pins->data, LOW);
+    digitalWrite(pins->clk, LOW);
+}
+
+// Samples both ADC channels and the button of a joystick into `sample`, stamped with the time.
+// Returns 0 on success, or -1 if a transfer was corrupt. Rejected samples are counted by the caller,
+// so every station counts its own.
+int joystickReadSample(const JoystickPins *pins, JoystickSample *sample)
+{
+    sample->timeNs = clockNowNs();
+    int x = readChannel(pins, X_CHANNEL);
+    int y = readChannel(pins, Y_CHANNEL);
+    if (x == -1 || y == -1)
+        return -1;
+
+    sample->x = x;
+    sample->y = y;
+    sample->button = !gpioDigitalRead(pins->button);
+    return 0;
+}
+
+// Takes up to `max` samples of a joystick at rest, at the sampling rate, for calibrating its axes.
+// Returns how many samples were taken; corrupt transfers are retried up to `max` times.
+int joystickCalibrationSamples(const JoystickPins *pins, unsigned char *x, unsigned char *y, int max)
+{
+    int count = 0;
+
+    for (int i = 0; i < max * 2 && count < max; i++)
+    {
+        int xValue = readChannel(pins, X_CHANNEL);
+        int yValue = readChannel(pins, Y_CHANNEL);
+        delayMicroseconds(1000000 / SAMPLE_HZ);
+
+        if (xValue == -1 || yValue == -1)
+            continue;
+
+        x[count] = xValue;
+        y[count] = yValue;
+        count++;
+    }
+
+    return count;
+}
+
+// Measures the rest point and noise of both axes, and sets the decoder up with them.
+static void calibrate()
+{
+    unsigned char xSamples[CALIBRATION_SAMPLES];
+    unsigned char ySamples[CALIBRATION_SAMPLES];
+    int count = joystickCalibrationSamples(&JOYSTICK_PINS, xSamples, ySamples, CALIBRATION_SAMPLES);
+
+    JoystickAxisCalibration xAxis;
+    JoystickAxisCalibration yAxis;
+    joystickCalibrate(&xAxis, xSamples, count);
+    joystickCalibrate(&yAxis, ySamples, count);
+    joystickDecoderInit(&decoder, &xAxis, &yAxis);
+
+    printf("Joystick calibrated: X rest %d noise %d (%d..%d), Y rest %d noise %d (%d..%d)\n",
+           xAxis.rest, xAxis.noise, xAxis.enterLow, xAxis.enterHigh,
+           yAxis.rest, yAxis.noise, yAxis.enterLow, yAxis.enterHigh);
+}
+
+// Samples the joystick at a fixed rate, decoding every sample into events.
+static void *sample(void *arg)
+{
+    traceThread("joystick");
+
+    uint64_t period = 1000000000ULL / SAMPLE_HZ;
+    uint64_t deadline = clockNowNs();
 
     while (1)
     {
-        unsigned char newXSample = readChannel(X_CHANNEL);
-        delay(25);
-        unsigned char newYSample = readChannel(Y_CHANNEL);
-        delay(25);
+        clockSleepUntilNs(deadline);
+        deadline += period;
+
+        // A corrupt transfer throws the whole sample away, the next one is only a period away.
+        JoystickSample sample;
+        if (joystickReadSample(&JOYSTICK_PINS, &sample) == -1)
+        {
+            atomic_fetch_add_explicit(&adcRejects, 1, memory_order_relaxed);
+            statsAdd(STATS_JOYSTICK_REJECTS, 1);
+            continue;
+        }
 
-        int xDiff = abs(lastXSample - newXSample);
-        int yDiff = abs(lastYSample - newYSample);
+        unsigned long index = atomic_load_explicit(&samplesWritten, memory_order_relaxed);
+        sampleRing[index % SAMPLE_RING_SIZE] = sample;
+        atomic_store_explicit(&samplesWritten, index + 1, memory_order_release);
+        statsAdd(STATS_JOYSTICK_SAMPLES, 1);
 
-        int xCentered = xDiff <= 10 && newXSample > 120 && newXSample < 130;
-        int yCentered = yDiff <= 10 && newYSample > 120 && newXSample < 130;
+        decode(&sample);
+
+        // Skip the slots we missed instead of sampling in a burst to catch up.
+        uint64_t now = clockNowNs();
+        if (now > deadline)
+            deadline = now;
+    }
 
-        if (xCentered && yCentered)
-            return;
+    return NULL;
+}
+
+// Decodes a sample into events and queues them.
+static void decode(const JoystickSample *sample)
+{
+    JoystickEvent events[JOYSTICK_DECODER_MAX_EVENTS];
+    int count = joystickDecoderFeed(&decoder, sample, events);
 
-        lastXSample = newXSample;
-        lastYSample = newYSample;
+    for (int i = 0; i < count; i++)
+    {
+        if (events[i].type == JOY_EVENT_DIR)
+            atomic_store_explicit(&stickCentered, 0, memory_order_release);
+        else if (events[i].type == JOY_EVENT_CENTER)
+            atomic_store_explicit(&stickCentered, 1, memory_order_release);
+        else
+            atomic_store_explicit(&buttonDown, events[i].type == JOY_EVENT_BUTTON_DOWN, memory_order_relaxed);
+
+        pushEvent(events[i].type, events[i].dir, events[i].timeNs);
+    }
+
+    atomic_store_explicit(&missedFlicks, decoder.missedFlicks, memory_order_relaxed);
+}
+
+// Queues an event for the game thread, dropping it if the queue is full.
+static void pushEvent(JoystickEventType type, int dir, uint64_t timeNs)
+{
+    unsigned int head = atomic_load_explicit(&eventHead, memory_order_relaxed);
+    if (head - atomic_load_explicit(&eventTail, memory_order_acquire) == EVENT_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&eventsDropped, 1, memory_order_relaxed);
+        statsAdd(STATS_JOYSTICK_DROPPED, 1);
+        return;
     }
+
+    eventQueue[head % EVENT_QUEUE_SIZE] = (JoystickEvent){type, dir, timeNs};
+    if (type == JOY_EVENT_DIR)
+        traceInstant("joystick.dir", dir);
+    else
+        traceInstant("joystick.event", type);
+    atomic_store_explicit(&eventHead, head + 1, memory_order_release);
+    statsAdd(STATS_JOYSTICK_EVENTS, 1);
+
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) == -1)
+        return;
 }
 
-// Reads an ADC channel, returning the byte-value of data received.
-static unsigned char readChannel(int channel)
+// Reads an ADC channel, returning the byte-value of data received, or -1 if the transfer was corrupt.
+static int readChannel(const JoystickPins *pins, int channel)
 {
     if (channel != 0 && channel != 1)
-        return 0;
+        return -1;
+
+    traceBegin("adc.read", channel);
 
     // Pull CS low, send HIGH start bit, send mode bit, and send channel bit.
-    digitalWrite(CLK, LOW);
-    digitalWrite(CS, LOW);
-    delayMicroseconds(20);
-    sendBit(1);       // Start bit
-    sendBit(1);       // Mode Bit (single ended = 1)
-    sendBit(channel); // Channel bit (0 = ch0, 1 = ch1)
-
-    // Send an extra clock pulse
-    digitalWrite(CLK, HIGH);
-    delayMicroseconds(20);
-    digitalWrite(CLK, LOW);
-    delayMicroseconds(20);
+    gpioDigitalWrite(pins->clk, LOW);
+    gpioDigitalWrite(pins->cs, LOW);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
+    sendBit(pins, 1);       // Start bit
+    sendBit(pins, 1);       // Mode Bit (single ended = 1)
+    sendBit(pins, channel); // Channel bit (0 = ch0, 1 = ch1)
+
+    // Send an extra clock pulse while the multiplexer settles.
+    gpioDigitalWrite(pins->clk, HIGH);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
+    gpioDigitalWrite(pins->clk, LOW);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
 
     // Read a byte representing that channel's ADC value.
-    unsigned char data = readByte();
+    int data = readByte(pins);
 
-    // End transaction
-    digitalWrite(CS, HIGH);
-    delay(5);
+    // End transaction. CS must stay high for a while before the next one pulls it low; with the GPIO
+    // fast path the next write would otherwise follow within nanoseconds.
+    gpioDigitalWrite(pins->cs, HIGH);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
 
+    traceEnd("adc.read", data);
     return data;
 }
 
-// Sends a single bit to the ADC.
-static void sendBit(int bit)
+// Sends a single bit to the ADC. The bit is set up on DATA for half a clock before the rising edge.
+static void sendBit(const JoystickPins *pins, int bit)
 {
-    digitalWrite(DATA, bit);
-    delayMicroseconds(20);
-    digitalWrite(CLK, HIGH);
-    delayMicroseconds(20);
-    digitalWrite(CLK, LOW);
-    delayMicroseconds(20);
+    gpioDigitalWrite(pins->data, bit);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
+    gpioDigitalWrite(pins->clk, HIGH);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
+    gpioDigitalWrite(pins->clk, LOW);
+    delayMicroseconds(ADC_HALF_CLOCK_US);
 }
 
 // Reads a single byte from the ADC.
-static unsigned char readByte()
+// The ADC sends the byte MSB first, then sends it again LSB first. The two copies share B0, so the
+// second one continues with B1. Returns the byte, or -1 if the two copies do not match.
+static int readByte(const JoystickPins *pins)
 {
-    pinMode(DATA, INPUT);
-    unsigned char data = 0;
+    pinMode(pins->data, INPUT);
+    unsigned char msbFirst = 0;
 
-    for (int i = 0; i < 16; i++)
+    for (int i = 0; i < 8; i++)
     {
         // Pulse the clock so the ADC sets the next bit.
-        digitalWrite(CLK, HIGH);
-        delayMicroseconds(20);
-
-        // The ADC sends MSBF byte first, then LSBF copy,
-        // so we ignore the latter but need to get it out of the buffer.
-        if (i > 7)
-            continue;
+        gpioDigitalWrite(pins->clk, HIGH);
+        delayMicroseconds(ADC_HALF_CLOCK_US);
 
         // Read the bit, shift the bits over by one and append the new bit.
-        int bit = digitalRead(DATA);
-        data = (data << 1) | bit;
+        int bit = gpioDigitalRead(pins->data);
+        msbFirst = (msbFirst << 1) | bit;
 
-        digitalWrite(CLK, LOW);
-        delayMicroseconds(20);
+        gpioDigitalWrite(pins->clk, LOW);
+        delayMicroseconds(ADC_HALF_CLOCK_US);
     }
 
-    digitalWrite(CLK, LOW);
-    pinMode(DATA, OUTPUT);
-    return data;
-}
\ No newline at end of file
+    unsigned char lsbFirst = msbFirst & 1;
+
+    for (int i = 1; i < 8; i++)
+    {
+        gpioDigitalWrite(pins->clk, HIGH);
+        delayMicroseconds(ADC_HALF_CLOCK_US);
+
+        lsbFirst |= gpioDigitalRead(pins->data) << i;
+
+        gpioDigitalWrite(pins->clk, LOW);
+        delayMicroseconds(ADC_HALF_CLOCK_US);
+    }
+
+    pinMode(pins->data, OUTPUT);
+    return msbFirst == lsbFirst ? msbFirst : -1;
+}
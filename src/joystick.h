@@ -1,14 +1,72 @@
 #ifndef JOYSTICK_H
 #define JOYSTICK_H
 
+#include <stdint.h>
+
 extern const int JOY_LEFT;
 extern const int JOY_RIGHT;
 extern const int JOY_UP;
 extern const int JOY_DOWN;
 
+typedef enum
+{
+    JOY_EVENT_DIR,
+    JOY_EVENT_CENTER,
+    JOY_EVENT_BUTTON_DOWN,
+    JOY_EVENT_BUTTON_UP,
+} JoystickEventType;
+
+// A decoded input, stamped with the monotonic time of the sample it was decoded from.
+typedef struct
+{
+    JoystickEventType type;
+    int dir;
+    uint64_t timeNs;
+} JoystickEvent;
+
+// A raw sample of both ADC channels and the button.
+typedef struct
+{
+    uint64_t timeNs;
+    unsigned char x;
+    unsigned char y;
+    unsigned char button;
+} JoystickSample;
+
+// The pins a joystick's ADC and button are wired to.
+typedef struct
+{
+    int data;
+    int clk;
+    int cs;
+    int button;
+} JoystickPins;
+
+typedef struct
+{
+    unsigned long samples;
+    unsigned long eventsDropped;
+    unsigned long missedFlicks;
+    unsigned long adcRejects;
+    unsigned int latencyAvgUs;
+    unsigned int latencyMaxUs;
+} JoystickStats;
+
+extern const JoystickPins JOYSTICK_PINS;
+
 void joystickInit();
 int joystickWaitForDir();
+int joystickWaitForDirTimeout(int timeoutMs);
 void joystickWaitForCenter();
 int joystickZedDown();
+int joystickNextEvent(JoystickEvent *event, int timeoutMs);
+void joystickFlushEvents();
+int joystickEventFd();
+int joystickReadSamples(JoystickSample *out, int max, unsigned long *cursor);
+void joystickGetStats(JoystickStats *stats);
+
+void joystickSetupPins(const JoystickPins *pins);
+int joystickReadSample(const JoystickPins *pins, JoystickSample *sample);
+int joystickCalibrationSamples(const JoystickPins *pins, unsigned char *x, unsigned char *y, int max);
 
-#endif
\ No newline at end of file
+#endif
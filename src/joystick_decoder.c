@@ -0,0 +1,240 @@
+/*
+
+Turns raw joystick samples into direction, center and button events.
+
+Each axis is calibrated at startup: the rest point and noise floor are measured while nobody
+touches the stick, and the direction thresholds are placed relative to them instead of at fixed
+values. Samples go through a median of 3 (which throws away single-sample spikes) and then a light
+moving average, and directions use hysteresis: an axis has to travel most of the way to recognise a
+direction, but only has to come back part of the way to count as centered again.
+
+*/
+
+#include <stdlib.h>
+
+#include "joystick_decoder.h"
+
+// How far an axis must travel from rest to recognise a direction, in percent of its range.
+#define ENTER_PERCENT 60
+
+// How close to rest an axis must come back to count as centered, in percent of its range.
+#define EXIT_PERCENT 25
+
+// Thresholds are kept at least this many times the noise floor away from rest.
+#define NOISE_MARGIN 4
+
+// A usable rest point must lie within this distance of the middle, with at most this much noise.
+#define MAX_REST_OFFSET 64
+#define MAX_NOISE 20
+
+// Used when the calibration samples are unusable, e.g. the stick was held during startup.
+#define DEFAULT_REST 128
+#define DEFAULT_NOISE 4
+
+// Moving averages are kept in fixed point with this many fractional bits.
+#define FILTER_SHIFT 4
+
+const int JOY_LEFT = 0;
+const int JOY_RIGHT = 1;
+const int JOY_UP = 2;
+const int JOY_DOWN = 3;
+
+static void placeThresholds(JoystickAxisCalibration *axis);
+static int isCentered(const JoystickAxisCalibration *axis, int value);
+static int median3(const unsigned char history[3]);
+
+// Measures an axis' rest point and noise floor from samples taken at rest, and derives its thresholds.
+void joystickCalibrate(JoystickAxisCalibration *axis, const unsigned char *samples, int count)
+{
+    axis->rest = DEFAULT_REST;
+    axis->noise = DEFAULT_NOISE;
+
+    if (count > 0)
+    {
+        long sum = 0;
+        for (int i = 0; i < count; i++)
+            sum += samples[i];
+
+        int rest = sum / count;
+        int noise = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (abs(samples[i] - rest) > noise)
+                noise = abs(samples[i] - rest);
+        }
+
+        if (abs(rest - DEFAULT_REST) <= MAX_REST_OFFSET && noise <= MAX_NOISE)
+        {
+            axis->rest = rest;
+            axis->noise = noise;
+        }
+    }
+
+    placeThresholds(axis);
+}
+
+// Resets a decoder to a centered stick with the given calibrations.
+void joystickDecoderInit(JoystickDecoder *decoder, const JoystickAxisCalibration *x, const JoystickAxisCalibration *y)
+{
+    *decoder = (JoystickDecoder){0};
+    decoder->axes[0] = *x;
+    decoder->axes[1] = *y;
+    decoder->dir = -1;
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        for (int i = 0; i < 3; i++)
+            decoder->history[axis][i] = decoder->axes[axis].rest;
+
+        decoder->filtered[axis] = decoder->axes[axis].rest << FILTER_SHIFT;
+    }
+}
+
+// Feeds a sample through the decoder, writing the events it produces into `events`.
+// Returns the number of events written, at most JOYSTICK_DECODER_MAX_EVENTS.
+int joystickDecoderFeed(JoystickDecoder *decoder, const JoystickSample *sample, JoystickEvent *events)
+{
+    const int positive[2] = {JOY_RIGHT, JOY_UP};
+    const int negative[2] = {JOY_LEFT, JOY_DOWN};
+
+    int count = 0;
+    int raw[2] = {sample->x, sample->y};
+    int value[2];
+    int rawPast = 0;
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        const JoystickAxisCalibration *cal = &decoder->axes[axis];
+        unsigned char *history = decoder->history[axis];
+
+        history[decoder->historyIndex] = raw[axis];
+        decoder->filtered[axis] += ((median3(history) << FILTER_SHIFT) - decoder->filtered[axis]) / 2;
+        value[axis] = decoder->filtered[axis] >> FILTER_SHIFT;
+
+        if (raw[axis] >= cal->enterHigh || raw[axis] <= cal->enterLow)
+            rawPast = 1;
+    }
+    decoder->historyIndex = decoder->historyIndex == 2 ? 0 : decoder->historyIndex + 1;
+    decoder->pastRun = rawPast ? decoder->pastRun + 1 : 0;
+
+    if (decoder->dir == -1)
+    {
+        // Pick the axis that travelled the furthest past its threshold, if any did.
+        int best = -1;
+        int bestTravel = 0;
+
+        for (int axis = 0; axis < 2; axis++)
+        {
+            const JoystickAxisCalibration *cal = &decoder->axes[axis];
+            int travel = 0;
+            int dir = -1;
+
+            if (value[axis] >= cal->enterHigh)
+            {
+                travel = (value[axis] - cal->rest) * 256 / (256 - cal->rest);
+                dir = positive[axis];
+            }
+            else if (value[axis] <= cal->enterLow)
+            {
+                travel = (cal->rest - value[axis]) * 256 / (cal->rest + 1);
+                dir = negative[axis];
+            }
+
+            if (dir != -1 && travel > bestTravel)
+            {
+                best = dir;
+                bestTravel = travel;
+            }
+        }
+
+        if (best != -1)
+        {
+            decoder->dir = best;
+            decoder->excursion = 0;
+            events[count++] = (JoystickEvent){JOY_EVENT_DIR, best, sample->timeNs};
+        }
+        else if (decoder->pastRun >= 2)
+        {
+            // Past a threshold for more than a single spike, but filtered out so far.
+            decoder->excursion = 1;
+        }
+        else if (decoder->excursion && isCentered(&decoder->axes[0], raw[0]) && isCentered(&decoder->axes[1], raw[1]))
+        {
+            // The stick went out and came back without a direction being recognised.
+            decoder->excursion = 0;
+            decoder->missedFlicks++;
+        }
+    }
+    else
+    {
+        if (isCentered(&decoder->axes[0], value[0]) && isCentered(&decoder->axes[1], value[1]))
+        {
+            decoder->dir = -1;
+            events[count++] = (JoystickEvent){JOY_EVENT_CENTER, -1, sample->timeNs};
+        }
+    }
+
+    // The button must read the same twice in a row to change.
+    if (sample->button == decoder->lastButton && sample->button != decoder->button)
+    {
+        decoder->button = sample->button;
+        events[count++] = (JoystickEvent){decoder->button ? JOY_EVENT_BUTTON_DOWN : JOY_EVENT_BUTTON_UP, -1, sample->timeNs};
+    }
+    decoder->lastButton = sample->button;
+
+    return count;
+}
+
+// Places an axis' enter and exit thresholds from its rest point and noise floor.
+static void placeThresholds(JoystickAxisCalibration *axis)
+{
+    int below = axis->rest;
+    int above = 255 - axis->rest;
+    int margin = axis->noise * NOISE_MARGIN;
+
+    int enterBelow = below * ENTER_PERCENT / 100;
+    int enterAbove = above * ENTER_PERCENT / 100;
+    int exitBelow = below * EXIT_PERCENT / 100;
+    int exitAbove = above * EXIT_PERCENT / 100;
+
+    // Keep the center band clear of the noise, and the direction thresholds beyond the center band.
+    if (exitBelow < margin)
+        exitBelow = margin;
+    if (exitAbove < margin)
+        exitAbove = margin;
+    if (enterBelow <= exitBelow)
+        enterBelow = exitBelow + 1;
+    if (enterAbove <= exitAbove)
+        enterAbove = exitAbove + 1;
+
+    axis->enterLow = axis->rest - enterBelow;
+    axis->enterHigh = axis->rest + enterAbove;
+    axis->exitLow = axis->rest - exitBelow;
+    axis->exitHigh = axis->rest + exitAbove;
+}
+
+// Returns whether an axis value lies within the axis' center band.
+static int isCentered(const JoystickAxisCalibration *axis, int value)
+{
+    return value > axis->exitLow && value < axis->exitHigh;
+}
+
+// Returns the median of three samples.
+static int median3(const unsigned char history[3])
+{
+    int a = history[0];
+    int b = history[1];
+    int c = history[2];
+
+    if (a > b)
+    {
+        int swap = a;
+        a = b;
+        b = swap;
+    }
+
+    if (b > c)
+        b = c;
+
+    return a > b ? a : b;
+}
@@ -0,0 +1,39 @@
+#ifndef JOYSTICK_DECODER_H
+#define JOYSTICK_DECODER_H
+
+#include "joystick.h"
+
+// The most events a single sample can decode into.
+#define JOYSTICK_DECODER_MAX_EVENTS 2
+
+// Where an axis rests, how noisy it is at rest, and the thresholds derived from that.
+typedef struct
+{
+    int rest;
+    int noise;
+    int enterLow;
+    int enterHigh;
+    int exitLow;
+    int exitHigh;
+} JoystickAxisCalibration;
+
+// Decodes raw samples into events. Has no hardware dependencies, so it can be fed synthetic traces.
+typedef struct
+{
+    JoystickAxisCalibration axes[2];
+    unsigned char history[2][3];
+    int filtered[2];
+    unsigned char historyIndex;
+    int dir;
+    int pastRun;
+    int excursion;
+    int lastButton;
+    int button;
+    unsigned long missedFlicks;
+} JoystickDecoder;
+
+void joystickCalibrate(JoystickAxisCalibration *axis, const unsigned char *samples, int count);
+void joystickDecoderInit(JoystickDecoder *decoder, const JoystickAxisCalibration *x, const JoystickAxisCalibration *y);
+int joystickDecoderFeed(JoystickDecoder *decoder, const JoystickSample *sample, JoystickEvent *events);
+
+#endif
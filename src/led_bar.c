@@ -1,36 +1,122 @@
 /*
 
 The LED bar uses a MY9221SS chip, which has a 2-wire custom protocol for sending bytes.
-We will use the 16 bit protocol (two bytes per led) to make it easy to assembly bytes.
-We only have 10 leds, so the last 4 bytes (in 16 bit mode) will just be 0x00 (off).
+A frame is a 16 bit command word followed by 12 16 bit grayscale words, one per output. The command
+word selects 16 bit grayscale, so every led has the chip's full 65536 levels.
+We only have 10 leds, so the last 2 words will just be 0x0000 (off).
+
+Led values are set on a perceptual 0-255 scale and go through a gamma table into the chip's linear
+16 bit range, so LED_HALF looks half as bright as LED_ON.
+
+The game thread only sets targets. A background thread fades every led towards its target (after an
+optional stagger, or a number of flashes) and sends a frame whenever the resulting levels change.
+Frames are bit-banged, so the thread limits its own rate: after each frame it waits long enough that
+sending frames never takes more than BUS_BUDGET_PERCENT of its time.
+
+Changes are made in transactions: `ledBarBegin`, any number of set, fade or flash calls, then
+`ledBarCommit`, which hands every change to the thread at once so it never shows half of one.
+Calls made outside of a transaction commit straight away. The thread sends a commit's frames over
+time, so the bytes each commit pushed are recorded once its fades settle, or a newer commit
+replaces it.
 
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <wiringPi.h>
 #include <wiringShift.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "clock.h"
+#include "gpio.h"
+#include "led_bar.h"
+#include "stats.h"
+#include "trace.h"
 
 // TODO: Define these pins.
 #define CLK 4
 #define DATA 5
 
+#define CHANNEL_COUNT 12
+
+// The bytes in a frame: the command word and one word per channel.
+#define FRAME_BYTES ((1 + CHANNEL_COUNT) * 2)
+
+// The command word selecting 16 bit grayscale on every channel.
+#define COMMAND_16_BIT 0x0300
+
+// The gamma the perceptual led values are corrected with.
+#define GAMMA 2.2
+
+// The largest share of time the refresh thread may spend sending frames, in percent.
+#define BUS_BUDGET_PERCENT 25
+
+// How often running fades are stepped, in milliseconds.
+#define FADE_TICK_MS 10
+
 const unsigned char LED_ON = 0xFF;
 const unsigned char LED_OFF = 0x00;
 const unsigned char LED_HALF = LED_ON / 2;
 
-void ledBarClear();
-void ledBarSet(int led, unsigned char value);
-void ledBarRefresh();
-static void startFrame();
-static void finalizeFrame();
-static void pushByte(unsigned char byte);
+// How an led gets to its target. Levels are perceptual, with 8 fractional bits.
+// The led holds `from` until `startNs`, flashes between `flash` and off `flashes` times,
+// then fades from where it was (or from off, after flashing) to `to` over `fadeMs`.
+typedef struct
+{
+    unsigned short from;
+    unsigned char to;
+    unsigned char flash;
+    unsigned char flashes;
+    unsigned short flashMs;
+    unsigned short fadeMs;
+    uint64_t startNs;
+} Fade;
+
+static void setFades(int first, int count, const Fade *fade, int staggerMs);
+static unsigned int fadePosition(const Fade *fade, uint64_t now, int *running);
+static unsigned short gammaLevel(unsigned int position);
+static void *refresh(void *arg);
+static void sendFrame(const unsigned short *levels);
+static void pushWord(unsigned short word);
 static void latch();
+static void notify(int fd);
 
-// The current LED bar status.
-static unsigned char currentLeds[10] = {0};
+// Perceptual value to linear 16 bit level.
+static unsigned short gammaTable[256];
+
+// The fades set up by the game thread, handed to the refresh thread on commit.
+static Fade pendingFades[LED_BAR_SIZE];
+static int pendingChanged = 0;
+
+// How many transactions are open. Changes are only committed once the outermost one is.
+static int transactionDepth = 0;
+
+// The committed fades, and whether the next frame must be sent even if nothing changed.
+//
+// Safety: Shared by the game thread and the refresh thread, and only touched with `fadeLock` held.
+static pthread_mutex_t fadeLock = PTHREAD_MUTEX_INITIALIZER;
+static Fade fades[LED_BAR_SIZE];
+static int forceRefresh = 1;
+static unsigned long commits = 0;
+
+// Wakes the refresh thread when fades are committed.
+static int wakeFd = -1;
+
+// Only used by the refresh thread.
 static int clkFlag = 0;
 
-// Initialize the LED bar, setting it to a clear status.
+// Statistics.
+static atomic_ulong framesSent = 0;
+static atomic_ulong bytesPushed = 0;
+static atomic_ulong busTimeUs = 0;
+
+// Initialize the LED bar, setting it to a clear status, and start the refresh thread.
 void ledBarInit()
 {
     pinMode(CLK, OUTPUT);
@@ -39,96 +125,308 @@ void ledBarInit()
     digitalWrite(CLK, LOW);
     digitalWrite(DATA, LOW);
 
-    // Send two-byte command mode.
-    pushByte(0);
-    pushByte(0);
-    // shiftOut(DATA, CLK, MSBFIRST, 0);
-    // shiftOut(DATA, CLK, MSBFIRST, 0);
+    for (int i = 0; i < 256; i++)
+        gammaTable[i] = pow(i / 255.0, GAMMA) * 65535.0 + 0.5;
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Every led starts off, and the first frame is always sent.
+    pthread_t refresh_thread;
+    pthread_create(&refresh_thread, NULL, refresh, NULL);
+}
+
+// Starts a transaction. Changes are held back until the matching `ledBarCommit`.
+// Transactions nest; only the outermost commit hands the changes over.
+void ledBarBegin()
+{
+    transactionDepth++;
+}
+
+// Ends a transaction, handing its changes to the refresh thread.
+// Returns 1 if any led target changed, or 0 if nothing will be sent.
+int ledBarCommit()
+{
+    if (transactionDepth > 0)
+        transactionDepth--;
+    if (transactionDepth > 0 || !pendingChanged)
+        return 0;
+
+    pthread_mutex_lock(&fadeLock);
+    memcpy(fades, pendingFades, sizeof(fades));
+    commits++;
+    pthread_mutex_unlock(&fadeLock);
 
-    ledBarClear();
+    pendingChanged = 0;
+    notify(wakeFd);
+    statsAdd(STATS_BAR_COMMITS, 1);
+
+    return 1;
 }
 
 // Clear the LED bar.
 void ledBarClear()
 {
-    startFrame();
+    ledBarSetRange(0, LED_BAR_SIZE, LED_OFF);
+}
+
+// Set an led to be a specific value.
+void ledBarSet(int led, unsigned char value)
+{
+    ledBarSetRange(led, 1, value);
+}
+
+// Set `count` leds starting at `first` to a specific value. Leds outside of the bar are ignored.
+void ledBarSetRange(int first, int count, unsigned char value)
+{
+    ledBarFadeRange(first, count, value, 0, 0);
+}
+
+// Fades `count` leds starting at `first` to a value over `fadeMs`, each led starting `staggerMs`
+// after the one before it. Leds that already have this value as their target are left alone.
+void ledBarFadeRange(int first, int count, unsigned char value, int fadeMs, int staggerMs)
+{
+    Fade fade = {0};
+    fade.to = value;
+    fade.fadeMs = fadeMs;
+
+    setFades(first, count, &fade, staggerMs);
+}
+
+// Flashes `count` leds starting at `first` between a value and off, `flashes` times, one flash
+// every `periodMs`. The leds are left off.
+void ledBarFlash(int first, int count, unsigned char value, int flashes, int periodMs)
+{
+    Fade fade = {0};
+    fade.to = LED_OFF;
+    fade.flash = value;
+    fade.flashes = periodMs > 0 ? flashes : 0;
+    fade.flashMs = periodMs;
+
+    setFades(first, count, &fade, 0);
+}
+
+// Sends the current led values again, whether they changed or not.
+void ledBarRefresh()
+{
+    pthread_mutex_lock(&fadeLock);
+    forceRefresh = 1;
+    pthread_mutex_unlock(&fadeLock);
 
-    for (int i = 0; i < 10; i++)
+    notify(wakeFd);
+}
+
+// Fills `stats` with the refresh thread's statistics.
+void ledBarGetStats(LedBarStats *stats)
+{
+    stats->frames = atomic_load_explicit(&framesSent, memory_order_relaxed);
+    stats->bytesPushed = atomic_load_explicit(&bytesPushed, memory_order_relaxed);
+    stats->busTimeUs = atomic_load_explicit(&busTimeUs, memory_order_relaxed);
+}
+
+// Starts `fade` on `count` leds starting at `first`, from wherever each led is now.
+// Each led that changes starts `staggerMs` after the one before it.
+static void setFades(int first, int count, const Fade *fade, int staggerMs)
+{
+    uint64_t now = clockNowNs();
+    int started = 0;
+
+    ledBarBegin();
+
+    for (int led = first; led < first + count; led++)
     {
-        currentLeds[i] = LED_OFF;
-        pushByte(LED_OFF);
+        if (led < 0 || led >= LED_BAR_SIZE)
+            continue;
+
+        Fade *pending = &pendingFades[led];
+        if (!fade->flashes && !pending->flashes && pending->to == fade->to)
+            continue;
+
+        int running;
+        unsigned short from = fadePosition(pending, now, &running);
+
+        *pending = *fade;
+        pending->from = from;
+        pending->startNs = now + (uint64_t)started++ * staggerMs * 1000000ULL;
+        pendingChanged = 1;
     }
 
-    finalizeFrame();
+    ledBarCommit();
 }
 
-// Set an led to be a specific value.
-void ledBarSet(int led, unsigned char value)
+// Returns the perceptual level of a fade at `now`, with 8 fractional bits.
+// Sets `running` if the fade has not settled on its target yet.
+static unsigned int fadePosition(const Fade *fade, uint64_t now, int *running)
 {
-    if (led < 0 || led > 9)
-        return;
+    *running = 1;
+    if (now < fade->startNs)
+        return fade->from;
+
+    uint64_t elapsedMs = (now - fade->startNs) / 1000000;
+    int from = fade->from;
+
+    if (fade->flashes)
+    {
+        uint64_t flashingMs = (uint64_t)fade->flashes * fade->flashMs;
+        if (elapsedMs < flashingMs)
+            return elapsedMs % fade->flashMs < fade->flashMs / 2u ? fade->flash << 8 : 0;
+
+        elapsedMs -= flashingMs;
+        from = 0;
+    }
+
+    int to = fade->to << 8;
+    if (elapsedMs >= fade->fadeMs)
+    {
+        *running = 0;
+        return to;
+    }
 
-    currentLeds[led] = value;
-    ledBarRefresh();
+    return from + (int64_t)(to - from) * (int64_t)elapsedMs / fade->fadeMs;
 }
 
-// Refreshes the led bar using the current led values.
-void ledBarRefresh()
+// Returns the linear 16 bit level of a perceptual level with 8 fractional bits,
+// interpolating between the gamma table's entries.
+static unsigned short gammaLevel(unsigned int position)
 {
-    startFrame();
-    for (int i = 0; i < 10; i++)
-        pushByte(currentLeds[i]);
+    unsigned int index = position >> 8;
+    if (index >= 255)
+        return gammaTable[255];
 
-    finalizeFrame();
+    unsigned int low = gammaTable[index];
+    unsigned int high = gammaTable[index + 1];
+    return low + (high - low) * (position & 0xFF) / 256;
 }
 
-static void startFrame()
+// Steps the fades and sends a frame whenever the levels change, within the bus time budget.
+static void *refresh(void *arg)
 {
-    pushByte(0);
-    pushByte(0);
+    traceThread("led bar");
+
+    unsigned short shown[LED_BAR_SIZE];
+    int shownValid = 0;
+    uint64_t nextFrame = 0;
+
+    // The latest commit picked up, and the bytes sent for it while its fades run.
+    unsigned long commit = 0;
+    unsigned long commitBytes = 0;
+    int measuring = 0;
+
+    struct pollfd fd = {.fd = wakeFd, .events = POLLIN};
+
+    while (1)
+    {
+        // Stay within the budget, however often new targets arrive.
+        clockSleepUntilNs(nextFrame);
+
+        unsigned short levels[LED_BAR_SIZE];
+        int running = 0;
+        uint64_t now = clockNowNs();
+
+        pthread_mutex_lock(&fadeLock);
+        for (int i = 0; i < LED_BAR_SIZE; i++)
+        {
+            int ledRunning;
+            levels[i] = gammaLevel(fadePosition(&fades[i], now, &ledRunning));
+            running |= ledRunning;
+        }
+        if (forceRefresh)
+            shownValid = 0;
+        forceRefresh = 0;
+        unsigned long committed = commits;
+        pthread_mutex_unlock(&fadeLock);
+
+        if (committed != commit)
+        {
+            if (measuring)
+                statsRecord(STATS_BAR_COMMIT_BYTES, commitBytes);
+            commit = committed;
+            commitBytes = 0;
+            measuring = 1;
+        }
+
+        if (!shownValid || memcmp(shown, levels, sizeof(levels)) != 0)
+        {
+            uint64_t start = clockNowNs();
+            traceBegin("bar.frame", 0);
+            sendFrame(levels);
+            traceEnd("bar.frame", 0);
+            uint64_t busNs = clockNowNs() - start;
+
+            memcpy(shown, levels, sizeof(levels));
+            shownValid = 1;
+            nextFrame = start + busNs * 100 / BUS_BUDGET_PERCENT;
+
+            commitBytes += FRAME_BYTES;
+            atomic_fetch_add_explicit(&framesSent, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&busTimeUs, busNs / 1000, memory_order_relaxed);
+            statsAdd(STATS_BAR_FRAMES, 1);
+            statsRecord(STATS_BAR_FRAME_US, busNs / 1000);
+        }
+
+        if (measuring && !running)
+        {
+            statsRecord(STATS_BAR_COMMIT_BYTES, commitBytes);
+            measuring = 0;
+        }
+
+        // Step again shortly while fading, otherwise wait for new targets.
+        uint64_t count;
+        if (clockPoll(&fd, 1, running ? FADE_TICK_MS * 1000000LL : -1) > 0 && read(wakeFd, &count, sizeof(count)) == -1)
+            continue;
+    }
+
+    return NULL;
 }
 
-// Finalizes the frame by sending the last four unused bytes, and latching.
-static void finalizeFrame()
+// Sends a frame of linear 16 bit levels and latches it.
+static void sendFrame(const unsigned short *levels)
 {
-    pushByte(LED_OFF);
-    pushByte(LED_OFF);
+    pushWord(COMMAND_16_BIT);
+
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+        pushWord(i < LED_BAR_SIZE ? levels[i] : 0);
+
     latch();
 }
 
-// Pushes a byte to the led bar.
-// We use 16 bit mode, so we "scale" the single byte into two in a non-linear way.
-static void pushByte(unsigned char byte)
+// Pushes a 16 bit word to the led bar, MSB first. Data is taken on both clock edges.
+static void pushWord(unsigned short word)
 {
-    // Merge the two bytes together to create 32 bits, with the last 16 unused, first 16 for two bytes.
-    unsigned char second_byte = byte;
-    unsigned int bits = (((unsigned int)byte << 8) | second_byte) << 16;
-
-    // Send the first 16 MSBs for two bytes.
     for (int i = 0; i < 16; i++)
     {
-        digitalWrite(DATA, (bits & 0x80000000) ? HIGH : LOW);
-        digitalWrite(CLK, !clkFlag);
+        gpioDigitalWrite(DATA, (word & 0x8000) ? HIGH : LOW);
+        gpioSettle();
+        gpioDigitalWrite(CLK, !clkFlag);
         clkFlag = !clkFlag;
 
-        bits <<= 1;
+        word <<= 1;
         delayMicroseconds(20);
     }
+
+    atomic_fetch_add_explicit(&bytesPushed, 2, memory_order_relaxed);
 }
 
 // Applies the new data to the chip.
 static void latch()
 {
-    digitalWrite(DATA, LOW);
+    gpioDigitalWrite(DATA, LOW);
     delayMicroseconds(500);
 
     for (int i = 0; i < 8; i++)
     {
-        digitalWrite(DATA, LOW);
+        gpioDigitalWrite(DATA, LOW);
         delayMicroseconds(1);
-        digitalWrite(DATA, HIGH);
+        gpioDigitalWrite(DATA, HIGH);
         delayMicroseconds(1);
     }
 
     delayMicroseconds(500);
-}
\ No newline at end of file
+}
+
+// Signals an eventfd.
+static void notify(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) == -1)
+        return;
+}
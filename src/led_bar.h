@@ -1,13 +1,28 @@
 #ifndef LED_BAR_H
 #define LED_BAR_H
 
+#define LED_BAR_SIZE 10
+
+typedef struct
+{
+    unsigned long frames;
+    unsigned long bytesPushed;
+    unsigned long busTimeUs;
+} LedBarStats;
+
 extern const unsigned char LED_ON;
 extern const unsigned char LED_OFF;
 extern const unsigned char LED_HALF;
 
 void ledBarInit();
+void ledBarBegin();
+int ledBarCommit();
 void ledBarClear();
 void ledBarRefresh();
 void ledBarSet(int led, unsigned char value);
+void ledBarSetRange(int first, int count, unsigned char value);
+void ledBarFadeRange(int first, int count, unsigned char value, int fadeMs, int staggerMs);
+void ledBarFlash(int first, int count, unsigned char value, int flashes, int periodMs);
+void ledBarGetStats(LedBarStats *stats);
 
-#endif
\ No newline at end of file
+#endif
@@ -5,231 +5,723 @@ To set both rows and columns, you must push two bytes.
 The first byte is for the row, and the second is for the column.
 The column's byte is inverted. So `1` is off, `0` is on.
 
+Wider displays chain several modules (panels) onto the same data, clock and latch pins. Every panel
+scans the same row at the same time, so each latch shifts one row and column byte per panel in a
+single burst, farthest panel first. A frame is still 8 row slots whatever the panel count: adding
+panels only lengthens the bursts, never the scan. The game's 8x8 frames and animations are shown on
+every panel; `ledMatrixPublishFramebuffer` gives each panel its own picture.
+
 The 8x8 matrix cannot turn on and off individual leds - it works based on rows and colums.
-We must instead cycle through each "pixel", quickly turning on then back off the corresponding LED,
-to create the illusion of an actual picture.
+We instead light one whole row at a time: the row byte selects a single row, and the column byte
+carries every lit pixel of that row. Cycling through the 8 rows quickly creates the illusion of
+an actual picture, and each frame only costs 8 latches no matter how many pixels are lit.
+
+The render thread runs on a fixed refresh rate. Each frame is split into 8 equal row slots, and
+the thread sleeps until the absolute deadline of the next slot instead of spinning, so the CPU used
+scales with the refresh rate.
+
+Frames are handed from the game thread to the render thread through a seqlock. Publishing a frame
+never blocks, and the render thread only picks a new frame up between two complete scans.
+
+Animations go through the same slot. The render thread plays them on its own time base, so the
+game thread only submits an animation and carries on. Whenever an animation ends, the render thread
+signals an eventfd that the game thread can wait on.
+
+Whenever the frame about to be scanned changes, it is also committed to the shared-memory frame
+ring when that is enabled (see frame_export.c), so viewers can follow the matrix from outside.
+
+Frames are kept packed as one byte per row, with the MSB being the left-most column.
+
+Each pixel has a 4-bit intensity, shown with bit-angle modulation. A frame is stored as 4 bit-planes,
+and each row slot is split into 15 units: plane 0 is shown for 1 unit, plane 1 for 2, plane 2 for 4
+and plane 3 for 8. That costs at most 4 latches per row no matter the picture. On/off frames have
+identical planes, so they still only latch once per row.
 
 */
 
+#include <limits.h>
 #include <stdio.h>
 #include <wiringPi.h>
 #include <wiringShift.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "animation.h"
+#include "clock.h"
+#include "frame_export.h"
+#include "gpio.h"
+#include "led_matrix.h"
+#include "stats.h"
+#include "trace.h"
 
 // Frame definitions for LED Matrix
+//
+// Each frame is drawn once as rows of pixels, then expanded both into the `int[8][8]` table
+// used by `ledMatrixSetFrame` and into the packed `_BITS` rows used by the render thread.
+
+#define FRAME_ROW(a, b, c, d, e, f, g, h) {a, b, c, d, e, f, g, h}
+#define PACKED_ROW(a, b, c, d, e, f, g, h) \
+    (((a) << 7) | ((b) << 6) | ((c) << 5) | ((d) << 4) | ((e) << 3) | ((f) << 2) | ((g) << 1) | (h))
 
-const int BLANK[8][8] = {};
+#define DEFINE_FRAME(name, rows)              \
+    const int name[8][8] = {rows(FRAME_ROW)}; \
+    const unsigned char name##_BITS[8] = {rows(PACKED_ROW)};
+
+#define BLANK_ROWS(R)          \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
 
 // ←
-const int ARROW_LEFT[8][8] = {
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 1, 0, 0, 0, 0},
-    {0, 0, 1, 1, 0, 0, 0, 0},
-    {0, 1, 1, 1, 1, 1, 1, 0},
-    {0, 0, 1, 1, 0, 0, 0, 0},
-    {0, 0, 0, 1, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-};
+#define ARROW_LEFT_ROWS(R)     \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 1, 0, 0, 0, 0), \
+    R(0, 0, 1, 1, 0, 0, 0, 0), \
+    R(0, 1, 1, 1, 1, 1, 1, 0), \
+    R(0, 0, 1, 1, 0, 0, 0, 0), \
+    R(0, 0, 0, 1, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
 
 // →
-const int ARROW_RIGHT[8][8] = {
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 1, 1, 0, 0},
-    {0, 1, 1, 1, 1, 1, 1, 0},
-    {0, 0, 0, 0, 1, 1, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-};
+#define ARROW_RIGHT_ROWS(R)    \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 1, 0, 0), \
+    R(0, 1, 1, 1, 1, 1, 1, 0), \
+    R(0, 0, 0, 0, 1, 1, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
 
 // ↑
-const int ARROW_UP[8][8] = {
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 1, 1, 1, 0, 0},
-    {0, 0, 1, 1, 1, 1, 1, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-};
+#define ARROW_UP_ROWS(R)       \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 1, 1, 1, 0, 0), \
+    R(0, 0, 1, 1, 1, 1, 1, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
 
 // ↓
-const int ARROW_DOWN[8][8] = {
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 1, 1, 1, 1, 1, 0},
-    {0, 0, 0, 1, 1, 1, 0, 0},
-    {0, 0, 0, 0, 1, 0, 0, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-};
+#define ARROW_DOWN_ROWS(R)     \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 1, 1, 1, 1, 1, 0), \
+    R(0, 0, 0, 1, 1, 1, 0, 0), \
+    R(0, 0, 0, 0, 1, 0, 0, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
 
 // X
-const int INCORRECT[8][8] = {
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 1, 0, 0, 0, 0, 1, 0},
-    {0, 0, 1, 0, 0, 1, 0, 0},
-    {0, 0, 0, 1, 1, 0, 0, 0},
-    {0, 0, 0, 1, 1, 0, 0, 0},
-    {0, 0, 1, 0, 0, 1, 0, 0},
-    {0, 1, 0, 0, 0, 0, 1, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-};
+#define INCORRECT_ROWS(R)      \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 1, 0, 0, 0, 0, 1, 0), \
+    R(0, 0, 1, 0, 0, 1, 0, 0), \
+    R(0, 0, 0, 1, 1, 0, 0, 0), \
+    R(0, 0, 0, 1, 1, 0, 0, 0), \
+    R(0, 0, 1, 0, 0, 1, 0, 0), \
+    R(0, 1, 0, 0, 0, 0, 1, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
 
 // ʘ
-const int READY[8][8] = {
-    {0, 0, 0, 0, 0, 0, 0, 0},
-    {0, 1, 1, 1, 1, 1, 1, 0},
-    {0, 1, 0, 0, 0, 0, 1, 0},
-    {0, 1, 0, 1, 1, 0, 1, 0},
-    {0, 1, 0, 1, 1, 0, 1, 0},
-    {0, 1, 0, 0, 0, 0, 1, 0},
-    {0, 1, 1, 1, 1, 1, 1, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0},
-};
-
-// Pin definitions
-#define LATCH 6
-#define CLK 10
-#define DATA 11
+#define READY_ROWS(R)          \
+    R(0, 0, 0, 0, 0, 0, 0, 0), \
+    R(0, 1, 1, 1, 1, 1, 1, 0), \
+    R(0, 1, 0, 0, 0, 0, 1, 0), \
+    R(0, 1, 0, 1, 1, 0, 1, 0), \
+    R(0, 1, 0, 1, 1, 0, 1, 0), \
+    R(0, 1, 0, 0, 0, 0, 1, 0), \
+    R(0, 1, 1, 1, 1, 1, 1, 0), \
+    R(0, 0, 0, 0, 0, 0, 0, 0)
+
+DEFINE_FRAME(BLANK, BLANK_ROWS)
+DEFINE_FRAME(ARROW_LEFT, ARROW_LEFT_ROWS)
+DEFINE_FRAME(ARROW_RIGHT, ARROW_RIGHT_ROWS)
+DEFINE_FRAME(ARROW_UP, ARROW_UP_ROWS)
+DEFINE_FRAME(ARROW_DOWN, ARROW_DOWN_ROWS)
+DEFINE_FRAME(INCORRECT, INCORRECT_ROWS)
+DEFINE_FRAME(READY, READY_ROWS)
+
+// Pin definitions of the game's matrix.
+const LedMatrixPins LED_MATRIX_PINS = {.latch = 6, .clk = 10, .data = 11};
+
+// Refresh rate limits, in frames per second.
+#define DEFAULT_REFRESH_HZ 500
+#define MIN_REFRESH_HZ 50
+#define MAX_REFRESH_HZ 2000
+
+// Waits shorter than this spin instead of sleeping, in nanoseconds.
+#define SPIN_THRESHOLD_NS 80000
+
+// How many recent scan periods are kept for jitter reports. Must be a power of two.
+#define SCAN_PERIOD_SAMPLES 1024
+
+// How many times a frame slot read retries a copy the writer overlapped before giving up on it.
+#define SLOT_READ_RETRIES 8
 
 // Prototypes
 static void *render(void *arg);
-static void pushByte(unsigned char byte);
-static void workMatrixFrame(int frame[8][8]);
+static void pushByte(const LedMatrixPins *pins, unsigned char byte);
+static uint64_t workMatrixFrame(const LedMatrixFramebuffer *framebuffer, int panels, uint64_t deadline, uint64_t rowPeriod);
+static void mirrorPanels(LedMatrixFramebuffer *framebuffer, int panels);
+static void finishAnimation(unsigned long generation);
+
+// The latest frame, or animation, published by the game thread for the render thread.
+static LedMatrixSlot frameSlot;
+
+// The panel layout. Set before the render thread starts, and never changed afterwards.
+static int panelsWide = 1;
+static int panelsHigh = 1;
+static int panelCount = 1;
+
+// Signalled by the render thread whenever an animation finishes or is replaced.
+static int animationFd = -1;
 
-// The current frame to be rendered.
+// The generation of the last animation played, and of the last animation that ended.
+static unsigned long playGeneration = 0;
+static atomic_ulong endedGeneration = 0;
+
+// The refresh rate the render thread is scheduled at.
+static atomic_uint refreshRate = DEFAULT_REFRESH_HZ;
+
+// Render statistics, measured by the render thread over the last second.
+static atomic_uint measuredFps = 0;
+static atomic_uint jitterAvgUs = 0;
+static atomic_uint jitterMaxUs = 0;
+static atomic_ulong overruns = 0;
+static atomic_ulong shownGeneration = 0;
+
+// The time between the starts of the most recent scans, for jitter reports.
 //
-// Safety: This global is used across two threads. One that sets it, and one that reads it.
-// Race conditions are acceptable as the effects do not cause issue to any logic, it is set-and-forget.
-static int currentFrame[8][8] = {};
+// Safety: Only written by the render thread. Readers may see a slot from a newer scan than the
+// count they read, which is harmless for a statistic.
+static atomic_uint scanPeriods[SCAN_PERIOD_SAMPLES];
+static atomic_ulong scanPeriodsWritten = 0;
+
+static pthread_t renderThread;
+
+// Sets how many panels are chained, and how they are laid out. Must be called before `ledMatrixInit`.
+// Returns 0 on success, or -1 if the layout has no panels or too many.
+int ledMatrixSetLayout(int wide, int high)
+{
+    if (wide < 1 || high < 1 || wide * high > LED_MATRIX_MAX_PANELS)
+        return -1;
+
+    panelsWide = wide;
+    panelsHigh = high;
+    panelCount = wide * high;
+    return 0;
+}
+
+// Returns the display's width in pixels.
+int ledMatrixWidth()
+{
+    return panelsWide * SIZE;
+}
+
+// Returns the display's height in pixels.
+int ledMatrixHeight()
+{
+    return panelsHigh * SIZE;
+}
 
 // Initialize the LED matrix and start the rendering thread.
 void ledMatrixInit()
 {
-    // Set pins
-    pinMode(LATCH, OUTPUT);
-    pinMode(CLK, OUTPUT);
-    pinMode(DATA, OUTPUT);
+    ledMatrixSetupPins(&LED_MATRIX_PINS);
+
+    animationFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
     // Start LED Matrix led thread.
-    pthread_t render_thread;
-    pthread_create(&render_thread, NULL, render, NULL);
+    pthread_create(&renderThread, NULL, render, NULL);
 }
 
 // Set the matrix to a new frame.
 void ledMatrixSetFrame(const int frame[8][8])
 {
-    memcpy(currentFrame, frame, sizeof(currentFrame));
+    unsigned char packed[8];
+
+    for (int row_i = 0; row_i < 8; row_i++)
+    {
+        unsigned char bits = 0;
+        for (int col_i = 0; col_i < 8; col_i++)
+            bits = (bits << 1) | (frame[row_i][col_i] != 0);
+
+        packed[row_i] = bits;
+    }
+
+    ledMatrixSetPackedFrame(packed);
+}
+
+// Set the matrix to a new frame that is already packed into row bitmaps.
+// Lit pixels are shown at full intensity.
+void ledMatrixSetPackedFrame(const unsigned char frame[8])
+{
+    LedMatrixFrame planes;
+    for (int b = 0; b < LED_MATRIX_BITS; b++)
+        memcpy(planes.planes[b], frame, SIZE);
+
+    ledMatrixPublishFrame(&planes);
+}
+
+// Set the matrix to a new frame with a per-pixel intensity from 0 (off) to 15 (full).
+void ledMatrixSetIntensityFrame(const unsigned char frame[8][8])
+{
+    LedMatrixFrame planes = {0};
+
+    for (int row_i = 0; row_i < 8; row_i++)
+    {
+        for (int col_i = 0; col_i < 8; col_i++)
+        {
+            unsigned char level = frame[row_i][col_i];
+            if (level > LED_MATRIX_MAX_INTENSITY)
+                level = LED_MATRIX_MAX_INTENSITY;
+
+            for (int b = 0; b < LED_MATRIX_BITS; b++)
+                planes.planes[b][row_i] |= ((level >> b) & 1) << (7 - col_i);
+        }
+    }
+
+    ledMatrixPublishFrame(&planes);
+}
+
+// Publish a bit-plane frame to the render thread, stopping any animation. Every panel shows it.
+void ledMatrixPublishFrame(const LedMatrixFrame *frame)
+{
+    ledMatrixSlotPublish(&frameSlot, frame, 1, NULL);
+}
+
+// Publish a frame for every panel to the render thread, stopping any animation.
+void ledMatrixPublishFramebuffer(const LedMatrixFramebuffer *framebuffer)
+{
+    ledMatrixSlotPublish(&frameSlot, framebuffer->panels, panelCount, NULL);
 }
 
-// Pushes a byte to the matrix shift registers.
-static void pushByte(unsigned char byte)
+// Turns every pixel of a framebuffer off.
+void ledMatrixFbClear(LedMatrixFramebuffer *framebuffer)
 {
-    digitalWrite(LATCH, LOW);
-    shiftOut(DATA, CLK, MSBFIRST, byte);
-    digitalWrite(LATCH, HIGH);
+    memset(framebuffer, 0, sizeof(LedMatrixFramebuffer));
+}
+
+// Sets a pixel of a framebuffer to an intensity from 0 (off) to 15 (full). Pixels off the display are ignored.
+void ledMatrixFbSetPixel(LedMatrixFramebuffer *framebuffer, int x, int y, unsigned char intensity)
+{
+    if (x < 0 || y < 0 || x >= ledMatrixWidth() || y >= ledMatrixHeight())
+        return;
+
+    if (intensity > LED_MATRIX_MAX_INTENSITY)
+        intensity = LED_MATRIX_MAX_INTENSITY;
+
+    LedMatrixFrame *panel = &framebuffer->panels[(y / SIZE) * panelsWide + x / SIZE];
+    unsigned char bit = 0x80 >> (x % SIZE);
+
+    for (int b = 0; b < LED_MATRIX_BITS; b++)
+    {
+        if ((intensity >> b) & 1)
+            panel->planes[b][y % SIZE] |= bit;
+        else
+            panel->planes[b][y % SIZE] &= ~bit;
+    }
+}
+
+// Draws the lit pixels of a packed 8x8 frame with its top left corner at (x, y), which may be
+// anywhere, so frames can be scrolled across the panels. Pixels off the display are clipped.
+void ledMatrixFbDrawPacked(LedMatrixFramebuffer *framebuffer, int x, int y, const unsigned char frame[8], unsigned char intensity)
+{
+    for (int row_i = 0; row_i < SIZE; row_i++)
+    {
+        for (int col_i = 0; col_i < SIZE; col_i++)
+        {
+            if (frame[row_i] & (0x80 >> col_i))
+                ledMatrixFbSetPixel(framebuffer, x + col_i, y + row_i, intensity);
+        }
+    }
+}
+
+// Start playing an animation on the matrix. Returns immediately, the render thread plays it.
+void ledMatrixPlay(const LedMatrixAnimation *animation)
+{
+    ledMatrixSlotPublish(&frameSlot, NULL, 1, animation);
+    playGeneration = ledMatrixFrameGeneration();
+}
+
+// Pauses the thread until the last animation played has finished, or has been replaced.
+// Never returns for a looping animation that is not replaced.
+void ledMatrixWaitAnimation()
+{
+    struct pollfd fd = {.fd = animationFd, .events = POLLIN};
+
+    while (atomic_load_explicit(&endedGeneration, memory_order_acquire) < playGeneration)
+    {
+        uint64_t count;
+        clockPoll(&fd, 1, -1);
+        if (read(animationFd, &count, sizeof(count)) == -1)
+            continue;
+    }
+}
+
+// Returns 1 if the last animation played has ended, or 0 if it is still playing.
+int ledMatrixAnimationDone()
+{
+    return atomic_load_explicit(&endedGeneration, memory_order_acquire) >= playGeneration;
+}
+
+// Returns the eventfd signalled whenever an animation finishes or is replaced.
+int ledMatrixAnimationFd()
+{
+    return animationFd;
+}
+
+// Returns the number of frames published so far.
+unsigned long ledMatrixFrameGeneration()
+{
+    return atomic_load_explicit(&frameSlot.sequence, memory_order_acquire) / 2;
+}
+
+// Set the refresh rate of the matrix, in frames per second.
+void ledMatrixSetRefreshRate(unsigned int hz)
+{
+    if (hz < MIN_REFRESH_HZ)
+        hz = MIN_REFRESH_HZ;
+    else if (hz > MAX_REFRESH_HZ)
+        hz = MAX_REFRESH_HZ;
+
+    atomic_store_explicit(&refreshRate, hz, memory_order_relaxed);
+}
+
+// Returns the number of complete frames the render thread drew during the last second.
+unsigned int ledMatrixGetFps()
+{
+    return atomic_load_explicit(&measuredFps, memory_order_relaxed);
+}
+
+// Copies the most recent scan periods into `periodsNs`, up to `max` of them.
+// Returns the number of periods copied.
+int ledMatrixGetScanPeriods(unsigned int *periodsNs, int max)
+{
+    unsigned long written = atomic_load_explicit(&scanPeriodsWritten, memory_order_relaxed);
+    unsigned long count = written < SCAN_PERIOD_SAMPLES ? written : SCAN_PERIOD_SAMPLES;
+    if (count > (unsigned long)max)
+        count = max;
+
+    for (unsigned long i = 0; i < count; i++)
+        periodsNs[i] = atomic_load_explicit(&scanPeriods[(written - count + i) % SCAN_PERIOD_SAMPLES], memory_order_relaxed);
+
+    return (int)count;
+}
+
+// Returns the render thread, so it can be scheduled.
+pthread_t ledMatrixRenderThread()
+{
+    return renderThread;
+}
+
+// Fills `stats` with the render thread's current statistics.
+void ledMatrixGetStats(LedMatrixStats *stats)
+{
+    stats->refreshRate = atomic_load_explicit(&refreshRate, memory_order_relaxed);
+    stats->fps = atomic_load_explicit(&measuredFps, memory_order_relaxed);
+    stats->jitterAvgUs = atomic_load_explicit(&jitterAvgUs, memory_order_relaxed);
+    stats->jitterMaxUs = atomic_load_explicit(&jitterMaxUs, memory_order_relaxed);
+    stats->overruns = atomic_load_explicit(&overruns, memory_order_relaxed);
+    stats->generation = atomic_load_explicit(&shownGeneration, memory_order_relaxed);
+}
+
+// Sets up the pins of a matrix, or of a chain of panels.
+void ledMatrixSetupPins(const LedMatrixPins *pins)
+{
+    pinMode(pins->latch, OUTPUT);
+    pinMode(pins->clk, OUTPUT);
+    pinMode(pins->data, OUTPUT);
+}
+
+// Shifts the row byte and a plane's column byte of `row_i` through every panel's registers in one
+// burst, farthest panel first, and latches them together.
+// Rows are active high starting at the top, columns are active low starting at the left.
+void ledMatrixLatchPlane(const LedMatrixPins *pins, const LedMatrixFramebuffer *framebuffer, int panels, int plane, int row_i)
+{
+    unsigned char row = 0x80 >> row_i;
+
+    gpioDigitalWrite(pins->latch, LOW);
+    for (int p = panels - 1; p >= 0; p--)
+    {
+        pushByte(pins, row);
+        pushByte(pins, ~framebuffer->panels[p].planes[plane][row_i]);
+    }
+    gpioDigitalWrite(pins->latch, HIGH);
+}
+
+// Returns 1 if `plane` lights different columns of `row_i` than the plane before it on any panel,
+// so it must be latched, or 0 if latching it would not change anything.
+int ledMatrixPlaneChanged(const LedMatrixFramebuffer *framebuffer, int panels, int plane, int row_i)
+{
+    for (int p = 0; p < panels; p++)
+    {
+        if (framebuffer->panels[p].planes[plane][row_i] != framebuffer->panels[p].planes[plane - 1][row_i])
+            return 1;
+    }
+
+    return 0;
+}
+
+// Returns when `plane` is latched, counted from the start of its row slot: planes are shown for 1,
+// 2, 4 and 8 fifteenths of the slot, in order.
+uint64_t ledMatrixPlaneOffsetNs(uint64_t rowPeriod, int plane)
+{
+    return rowPeriod * ((1 << plane) - 1) / LED_MATRIX_MAX_INTENSITY;
+}
+
+// Pushes a byte into the matrix shift registers, without latching it.
+static void pushByte(const LedMatrixPins *pins, unsigned char byte)
+{
+    gpioShiftOut(pins->data, pins->clk, byte);
+}
+
+// Copies the first panel's frame onto every other panel.
+static void mirrorPanels(LedMatrixFramebuffer *framebuffer, int panels)
+{
+    for (int p = 1; p < panels; p++)
+        framebuffer->panels[p] = framebuffer->panels[0];
 }
 
 // Starts the rendering loop to render complete frames.
 static void *render(void *arg)
 {
     printf("LED Matrix Render Thread Started\n");
+    traceThread("matrix");
+
+    uint64_t deadline = clockNowNs();
+    uint64_t windowStart = deadline;
+    uint64_t jitterSumNs = 0;
+    uint64_t jitterPeakNs = 0;
+    uint64_t lastFrameStart = 0;
+    unsigned int frames = 0;
+
+    LedMatrixFramebuffer framebuffer = {0};
+    LedMatrixFramebuffer published = {0};
+    const LedMatrixAnimation *animation = NULL;
+    unsigned long sequence = 0;
+
+    Animator animator = {0};
+    unsigned long animatorGeneration = 0;
+
     while (1)
     {
-        workMatrixFrame(currentFrame);
+        uint64_t rowPeriod = 1000000000ULL / atomic_load_explicit(&refreshRate, memory_order_relaxed) / 8;
+
+        // The first row slot of each frame measures how late the thread woke up.
+        clockSleepUntilNs(deadline);
+        uint64_t frameStart = clockNowNs();
+        uint64_t jitterNs = frameStart - deadline;
+        jitterSumNs += jitterNs;
+        if (jitterNs > jitterPeakNs)
+            jitterPeakNs = jitterNs;
+
+        if (lastFrameStart)
+        {
+            uint64_t periodNs = frameStart - lastFrameStart;
+            unsigned long written = atomic_load_explicit(&scanPeriodsWritten, memory_order_relaxed);
+            atomic_store_explicit(&scanPeriods[written % SCAN_PERIOD_SAMPLES], periodNs > UINT_MAX ? UINT_MAX : (unsigned int)periodNs, memory_order_relaxed);
+            atomic_store_explicit(&scanPeriodsWritten, written + 1, memory_order_relaxed);
+        }
+        lastFrameStart = frameStart;
+
+        // Pick up a newly published frame only between scans, so every scan shows one frame.
+        int changed = 0;
+        if (ledMatrixSlotRead(&frameSlot, &published, panelCount, &animation, &sequence))
+        {
+            changed = 1;
+            atomic_store_explicit(&shownGeneration, sequence / 2, memory_order_relaxed);
+            traceInstant("matrix.shown", sequence / 2);
+
+            if (animation)
+            {
+                // Animations start from whatever is fully lit on the matrix right now.
+                animatorStart(&animator, animation, framebuffer.panels[0].planes[LED_MATRIX_BITS - 1], frameStart);
+                animatorGeneration = sequence / 2;
+                if (!animator.animation)
+                    finishAnimation(animatorGeneration);
+            }
+            else
+            {
+                // A static frame replaces any animation that was published before it.
+                animator.animation = NULL;
+                framebuffer = published;
+                finishAnimation(sequence / 2);
+            }
+        }
+
+        // Animations are drawn on the first panel and shown on all of them.
+        if (animator.animation)
+        {
+            changed = 1;
+            if (animatorStep(&animator, frameStart, &framebuffer.panels[0]))
+                finishAnimation(animatorGeneration);
+            mirrorPanels(&framebuffer, panelCount);
+        }
+
+        if (changed)
+            frameExportCommit(&framebuffer, panelCount, frameStart, sequence / 2);
+
+        traceBegin("matrix.frame", 0);
+        deadline = workMatrixFrame(&framebuffer, panelCount, deadline, rowPeriod);
+        traceEnd("matrix.frame", 0);
+        frames++;
+
+        uint64_t now = clockNowNs();
+        statsAdd(STATS_MATRIX_FRAMES, 1);
+        statsRecord(STATS_MATRIX_FRAME_US, (now - frameStart) / 1000);
+
+        // If the next frame should already have started, we overran. Restart the schedule from now
+        // rather than rushing through the missed slots.
+        if (now > deadline)
+        {
+            atomic_fetch_add_explicit(&overruns, 1, memory_order_relaxed);
+            statsAdd(STATS_MATRIX_OVERRUNS, 1);
+            deadline = now;
+        }
+
+        // Publish the statistics once per second.
+        if (now - windowStart >= 1000000000ULL)
+        {
+            atomic_store_explicit(&measuredFps, (unsigned int)(frames * 1000000000ULL / (now - windowStart)), memory_order_relaxed);
+            atomic_store_explicit(&jitterAvgUs, (unsigned int)(jitterSumNs / frames / 1000), memory_order_relaxed);
+            atomic_store_explicit(&jitterMaxUs, (unsigned int)(jitterPeakNs / 1000), memory_order_relaxed);
+            frames = 0;
+            jitterSumNs = 0;
+            jitterPeakNs = 0;
+            windowStart = now;
+        }
     }
+
+    return NULL;
 }
 
-// Work an entire frame to the 8x8 matrix.
+// Work an entire frame to the first `panels` panels, starting at `deadline`.
 // The matrix cannot enable/disable individual leds
-// We must work entire rows/columns VERY fast to creat the illusion of a full picture.
-static void workMatrixFrame(int frame[8][8])
+// We light one row at a time, each for one row slot, to create the illusion of a full picture.
+// Returns the deadline of the next frame.
+static uint64_t workMatrixFrame(const LedMatrixFramebuffer *framebuffer, int panels, uint64_t deadline, uint64_t rowPeriod)
 {
-
     for (int row_i = 0; row_i < 8; row_i++)
     {
-        unsigned char row = 0b0;
-        unsigned char col = 0b11111111;
+        // Wait until the row's slot begins, so each row stays lit for the same amount of time.
+        // The caller has already waited for the first slot.
+        if (row_i > 0)
+            clockSleepUntilNs(deadline);
 
-        for (int col_i = 0; col_i < 8; col_i++)
-        {
-            // Turn off all LEDs to make way for the next pixel.
-            pushByte(0);
-            pushByte(0);
+        ledMatrixLatchPlane(&LED_MATRIX_PINS, framebuffer, panels, 0, row_i);
 
-            int cell = frame[row_i][col_i];
+        // Show the other planes for 2, 4 and 8 units, skipping latches that would not change anything.
+        for (int b = 1; b < LED_MATRIX_BITS; b++)
+        {
+            if (!ledMatrixPlaneChanged(framebuffer, panels, b, row_i))
+                continue;
 
-            // If the cell is enabled, we enable the row and col for the matrix.
-            if (cell)
-            {
-                switch (row_i)
-                {
-                case 0:
-                    row = 0b10000000;
-                    break;
-                case 1:
-                    row = 0b01000000;
-                    break;
-                case 2:
-                    row = 0b00100000;
-                    break;
-                case 3:
-                    row = 0b00010000;
-                    break;
-                case 4:
-                    row = 0b00001000;
-                    break;
-                case 5:
-                    row = 0b00000100;
-                    break;
-                case 6:
-                    row = 0b00000010;
-                    break;
-                case 7:
-                    row = 0b00000001;
-                    break;
-                }
-
-                switch (col_i)
-                {
-                case 0:
-                    col = 0b01111111;
-                    break;
-                case 1:
-                    col = 0b10111111;
-                    break;
-                case 2:
-                    col = 0b11011111;
-                    break;
-                case 3:
-                    col = 0b11101111;
-                    break;
-                case 4:
-                    col = 0b11110111;
-                    break;
-                case 5:
-                    col = 0b11111011;
-                    break;
-                case 6:
-                    col = 0b11111101;
-                    break;
-                case 7:
-                    col = 0b11111110;
-                    break;
-                }
-
-                pushByte(row);
-                pushByte(col);
-
-                // Wait so the LED has time to turn on.
-                delayMicroseconds(50);
-            }
+            clockWaitUntilNs(deadline + ledMatrixPlaneOffsetNs(rowPeriod, b), SPIN_THRESHOLD_NS);
+            ledMatrixLatchPlane(&LED_MATRIX_PINS, framebuffer, panels, b, row_i);
         }
+
+        deadline += rowPeriod;
+    }
+
+    return deadline;
+}
+
+// Publishes `count` panels' frames or an animation into a frame slot. When `panels` is NULL the
+// frame words are left untouched. `count` frames are shown on as many panels; a single one is
+// shown on every panel.
+//
+// Safety: The writer makes `sequence` odd while it copies a frame in and even once the frame is
+// complete. The reader retries whenever the sequence was odd or changed during its copy, so it can
+// never see a torn frame. The retries are bounded, so a reader on a real-time thread never spins on a
+// writer that was preempted mid-copy. Only one thread may publish into a slot at a time.
+void ledMatrixSlotPublish(LedMatrixSlot *slot, const LedMatrixFrame *panels, int count, const LedMatrixAnimation *animation)
+{
+    unsigned int words[LED_MATRIX_MAX_PANELS * LED_MATRIX_FRAME_WORDS];
+    int frameWords = count * LED_MATRIX_FRAME_WORDS;
+    if (panels)
+        memcpy(words, panels, count * sizeof(LedMatrixFrame));
+
+    unsigned long sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (panels)
+    {
+        for (int i = 0; i < frameWords; i++)
+            atomic_store_explicit(&slot->words[i], words[i], memory_order_relaxed);
+        atomic_store_explicit(&slot->panels, count, memory_order_relaxed);
     }
-}
\ No newline at end of file
+
+    atomic_store_explicit(&slot->animation, (uintptr_t)animation, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+
+    statsAdd(STATS_MATRIX_PUBLISHED, 1);
+}
+
+// Copies the latest complete frame and animation out of a frame slot, filling `panels` panels.
+// Returns 1 if a frame newer than `*sequence` was copied, updating `*sequence`, or 0 otherwise. A
+// frame the writer keeps overlapping is given up on after SLOT_READ_RETRIES tries, returning 0, so the
+// caller keeps the last complete frame and picks the new one up on its next read.
+int ledMatrixSlotRead(LedMatrixSlot *slot, LedMatrixFramebuffer *framebuffer, int panels, const LedMatrixAnimation **animation, unsigned long *sequence)
+{
+    for (int attempt = 0; attempt < SLOT_READ_RETRIES; attempt++)
+    {
+        unsigned long before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (before == *sequence)
+            return 0;
+
+        // The writer is in the middle of copying a frame in.
+        if (before & 1)
+            continue;
+
+        int count = atomic_load_explicit(&slot->panels, memory_order_relaxed);
+        if (count < 1 || count > LED_MATRIX_MAX_PANELS)
+            count = 1;
+
+        unsigned int words[LED_MATRIX_MAX_PANELS * LED_MATRIX_FRAME_WORDS];
+        for (int i = 0; i < count * LED_MATRIX_FRAME_WORDS; i++)
+            words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+
+        uintptr_t playing = atomic_load_explicit(&slot->animation, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != before)
+            continue;
+
+        memcpy(framebuffer->panels, words, count * sizeof(LedMatrixFrame));
+        if (count == 1)
+            mirrorPanels(framebuffer, panels);
+        *animation = (const LedMatrixAnimation *)playing;
+        *sequence = before;
+        return 1;
+    }
+
+    statsAdd(STATS_MATRIX_SLOT_BUSY, 1);
+    return 0;
+}
+
+// Records that every animation published up to `generation` has ended, and wakes up any waiters.
+static void finishAnimation(unsigned long generation)
+{
+    uint64_t one = 1;
+
+    atomic_store_explicit(&endedGeneration, generation, memory_order_release);
+    if (write(animationFd, &one, sizeof(one)) == -1)
+        return;
+}
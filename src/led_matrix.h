@@ -1,9 +1,93 @@
 #ifndef LED_MATRIX_H
 #define LED_MATRIX_H
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
 #define SIZE 8
 
-extern int currentFrame[SIZE][SIZE];
+// The number of bits of intensity per pixel, and the resulting maximum intensity.
+#define LED_MATRIX_BITS 4
+#define LED_MATRIX_MAX_INTENSITY ((1 << LED_MATRIX_BITS) - 1)
+
+// A frame split into bit-planes: plane `b` holds bit `b` of every pixel's intensity,
+// packed one byte per row with the MSB being the left-most column.
+typedef struct
+{
+    unsigned char planes[LED_MATRIX_BITS][SIZE];
+} LedMatrixFrame;
+
+// The most panels that can be chained into one display.
+#define LED_MATRIX_MAX_PANELS 8
+
+// A display of chained panels, one bit-plane frame per panel in chain order: panel 0 is wired to
+// the Pi. Panels are laid out left to right, then top to bottom.
+typedef struct
+{
+    LedMatrixFrame panels[LED_MATRIX_MAX_PANELS];
+} LedMatrixFramebuffer;
+
+// The pins a matrix, or a chain of panels, is wired to.
+typedef struct
+{
+    int latch;
+    int clk;
+    int data;
+} LedMatrixPins;
+
+// The number of words a panel's frame is copied through a frame slot in.
+#define LED_MATRIX_FRAME_WORDS (int)(sizeof(LedMatrixFrame) / sizeof(unsigned int))
+
+// Hands frames from one publishing thread to one render loop without locking. See led_matrix.c.
+typedef struct
+{
+    atomic_ulong sequence;
+    atomic_int panels;
+    atomic_uint words[LED_MATRIX_MAX_PANELS * LED_MATRIX_FRAME_WORDS];
+    atomic_uintptr_t animation;
+} LedMatrixSlot;
+
+// How a keyframe is brought onto the matrix.
+typedef enum
+{
+    LED_MATRIX_CUT,
+    LED_MATRIX_SLIDE_LEFT,
+    LED_MATRIX_SLIDE_RIGHT,
+    LED_MATRIX_SLIDE_UP,
+    LED_MATRIX_SLIDE_DOWN,
+    LED_MATRIX_WIPE,
+    LED_MATRIX_FADE,
+} LedMatrixTransition;
+
+// A packed frame, the transition that brings it on, and how long it is held afterwards.
+typedef struct
+{
+    const unsigned char *frame;
+    LedMatrixTransition transition;
+    unsigned short transitionMs;
+    unsigned short holdMs;
+} LedMatrixKeyframe;
+
+// A sequence of keyframes. The keyframes must stay alive while the animation plays.
+typedef struct
+{
+    const LedMatrixKeyframe *keyframes;
+    int count;
+    int loop;
+} LedMatrixAnimation;
+
+typedef struct
+{
+    unsigned int refreshRate;
+    unsigned int fps;
+    unsigned int jitterAvgUs;
+    unsigned int jitterMaxUs;
+    unsigned long overruns;
+    unsigned long generation;
+} LedMatrixStats;
+
+extern const LedMatrixPins LED_MATRIX_PINS;
 
 extern const int BLANK[SIZE][SIZE];
 extern const int ARROW_LEFT[SIZE][SIZE];
@@ -13,7 +97,42 @@ extern const int ARROW_DOWN[SIZE][SIZE];
 extern const int INCORRECT[SIZE][SIZE];
 extern const int READY[SIZE][SIZE];
 
+extern const unsigned char BLANK_BITS[SIZE];
+extern const unsigned char ARROW_LEFT_BITS[SIZE];
+extern const unsigned char ARROW_RIGHT_BITS[SIZE];
+extern const unsigned char ARROW_UP_BITS[SIZE];
+extern const unsigned char ARROW_DOWN_BITS[SIZE];
+extern const unsigned char INCORRECT_BITS[SIZE];
+extern const unsigned char READY_BITS[SIZE];
+
+int ledMatrixSetLayout(int panelsWide, int panelsHigh);
+int ledMatrixWidth();
+int ledMatrixHeight();
 void ledMatrixInit();
 void ledMatrixSetFrame(const int frame[8][8]);
+void ledMatrixSetPackedFrame(const unsigned char frame[8]);
+void ledMatrixSetIntensityFrame(const unsigned char frame[8][8]);
+void ledMatrixPublishFrame(const LedMatrixFrame *frame);
+void ledMatrixPublishFramebuffer(const LedMatrixFramebuffer *framebuffer);
+void ledMatrixFbClear(LedMatrixFramebuffer *framebuffer);
+void ledMatrixFbSetPixel(LedMatrixFramebuffer *framebuffer, int x, int y, unsigned char intensity);
+void ledMatrixFbDrawPacked(LedMatrixFramebuffer *framebuffer, int x, int y, const unsigned char frame[8], unsigned char intensity);
+void ledMatrixPlay(const LedMatrixAnimation *animation);
+void ledMatrixWaitAnimation();
+int ledMatrixAnimationDone();
+int ledMatrixAnimationFd();
+unsigned long ledMatrixFrameGeneration();
+void ledMatrixSetRefreshRate(unsigned int hz);
+unsigned int ledMatrixGetFps();
+void ledMatrixGetStats(LedMatrixStats *stats);
+int ledMatrixGetScanPeriods(unsigned int *periodsNs, int max);
+pthread_t ledMatrixRenderThread();
+
+void ledMatrixSetupPins(const LedMatrixPins *pins);
+void ledMatrixLatchPlane(const LedMatrixPins *pins, const LedMatrixFramebuffer *framebuffer, int panels, int plane, int row_i);
+int ledMatrixPlaneChanged(const LedMatrixFramebuffer *framebuffer, int panels, int plane, int row_i);
+uint64_t ledMatrixPlaneOffsetNs(uint64_t rowPeriod, int plane);
+void ledMatrixSlotPublish(LedMatrixSlot *slot, const LedMatrixFrame *panels, int count, const LedMatrixAnimation *animation);
+int ledMatrixSlotRead(LedMatrixSlot *slot, LedMatrixFramebuffer *framebuffer, int panels, const LedMatrixAnimation **animation, unsigned long *sequence);
 
 #endif
\ No newline at end of file
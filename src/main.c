@@ -15,7 +15,7 @@ Created by [Miles Murgaw](https://github.com/DogeDark) as a final project for CN
 
 ### Project Organization:
 
-This project is organized into a handful of files.
+This project is organized into a handful of files, listed in the README.
 - main.c contains the main game logic and control flow.
 - led_matrix.c contains the led matrix rendering logic.
 - led_bar.c contains the led bar rendering logic.
@@ -23,10 +23,7 @@ This project is organized into a handful of files.
 
 ### Compiling
 This project is meant to be compiled on a Raspberry Pi. This has only been tested on an RPI 4B.
-
-```bash
-gcc main.c led_matrix.c led_bar.c buzzer.c -o final -lwiringPi -lpthread
-```
+The full build line is in the README's Compiling section.
 */
 
 #include <signal.h>
@@ -34,23 +31,167 @@ gcc main.c led_matrix.c led_bar.c buzzer.c -o final -lwiringPi -lpthread
 #include <stdlib.h>
 #include <wiringPi.h>
 #include <time.h>
-#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
+#include "assets.h"
+#include "frame_export.h"
 #include "led_matrix.h"
 #include "led_bar.h"
 #include "buzzer.h"
 #include "joystick.h"
-
-void startMenu();
-void game();
-void displayPattern(int pattern);
+#include "gpio.h"
+#include "clock.h"
+#include "reactor.h"
+#include "rt.h"
+#include "sequence.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+
+// The states of the game. Each state is entered once, and left when an event arrives.
+typedef enum
+{
+	STATE_READY,
+	STATE_COUNTDOWN,
+	STATE_SHOW_SEQUENCE,
+	STATE_AWAIT_INPUT,
+	STATE_SUCCESS,
+	STATE_FAIL,
+} GameState;
+
+void enterState(GameState state);
+void onJoystick(int fd, void *data);
+void onAnimationDone(int fd, void *data);
+void onBuzzerDone(int fd, void *data);
+void onTimer(int fd, void *data);
+void handleEvent(const JoystickEvent *event);
+void handleInput(int input);
+void sequenceShown();
+void tuneDone();
+void gameOverDone();
+int replay(const char *path);
+void printStats();
+int displayPatterns(const PatternSequence *patterns, unsigned long first);
+void reportAutoplay();
+void loadArt();
+void onAssetsChanged(int fd, void *data);
 int rand_range(int min, int max);
+void onInterrupt(int fd, void *data);
+uint64_t threadCpuNs();
 void interruptHandler(const int _signal);
 
+// Timing of each pattern shown in the sequence, in milliseconds.
+// Each pattern slides in, is held, then fades out.
+#define PATTERN_SLIDE_MS 120
+#define PATTERN_HOLD_MS 330
+#define PATTERN_FADE_MS 100
+#define PATTERN_STEP_MS (PATTERN_SLIDE_MS + PATTERN_HOLD_MS + PATTERN_FADE_MS)
+
+// How long each pattern's tone is played, both when it is shown and when it is entered.
+#define PATTERN_TONE_MS 50
+
+// In auto-play, each new pattern is cut in and held this long, and only the newest one is shown.
+#define AUTOPLAY_STEP_MS 4
+
+// How many levels auto-play plays between throughput reports.
+#define AUTOPLAY_REPORT_LEVELS 100
+
+// How long the render thread's scan periods are sampled for, before and after the RT profile.
+#define RT_JITTER_MS 1000
+
+// Where performance counter snapshots are written, unless STATS_FILE says otherwise.
+#define DEFAULT_STATS_FILE "/tmp/memory-game.stats"
+
+// The shared-memory ring frames are exported to, unless FRAME_EXPORT names another.
+#define DEFAULT_FRAME_EXPORT "/memory-game-frames"
+
+// How long the fail screen is shown before the game is ready again, in milliseconds.
+#define GAME_OVER_MS 3000
+
+// How long a new level takes to fade in on the LED bar, in milliseconds.
+#define LEVEL_FADE_MS 200
+
+// Breathes the ready frame in and out while waiting for a player.
+static const LedMatrixKeyframe READY_KEYFRAMES[] = {
+	{READY_BITS, LED_MATRIX_FADE, 400, 800},
+	{BLANK_BITS, LED_MATRIX_FADE, 400, 200},
+};
+static const LedMatrixAnimation READY_ANIMATION = {READY_KEYFRAMES, 2, 1};
+
+// Flashes the incorrect frame in step with the incorrect tune, then leaves it on.
+static const LedMatrixKeyframe INCORRECT_KEYFRAMES[] = {
+	{INCORRECT_BITS, LED_MATRIX_CUT, 0, 220},
+	{BLANK_BITS, LED_MATRIX_CUT, 0, 220},
+	{INCORRECT_BITS, LED_MATRIX_CUT, 0, 220},
+	{BLANK_BITS, LED_MATRIX_CUT, 0, 220},
+	{INCORRECT_BITS, LED_MATRIX_CUT, 0, 0},
+};
+static const LedMatrixAnimation INCORRECT_ANIMATION = {INCORRECT_KEYFRAMES, 5, 0};
+
+// The keyframes of the pattern sequence being shown, two per pattern, and its tones, one per
+// pattern. Both grow with the sequence, and hold `displayCapacity` patterns.
+static LedMatrixKeyframe *sequenceKeyframes = NULL;
+static BuzNote *sequenceNotes = NULL;
+static unsigned long displayCapacity = 0;
+static LedMatrixAnimation sequenceAnimation = {NULL, 0, 0};
+
+#define LEFT_PATTERN 0
+#define RIGHT_PATTERN 1
+#define UP_PATTERN 2
+#define DOWN_PATTERN 3
+#define INVALID_PATTERN -1
+
+// The tone of each pattern, indexed by pattern.
+static const int PATTERN_TONES[] = {523, 659, 784, 392};
+
+// The built-in arrow of each pattern, and the transition it slides in with, indexed by pattern.
+static const unsigned char *const PATTERN_ARROWS[] = {ARROW_LEFT_BITS, ARROW_RIGHT_BITS, ARROW_UP_BITS, ARROW_DOWN_BITS};
+static const LedMatrixTransition PATTERN_SLIDES[] = {LED_MATRIX_SLIDE_LEFT, LED_MATRIX_SLIDE_RIGHT, LED_MATRIX_SLIDE_UP, LED_MATRIX_SLIDE_DOWN};
+
+// The names of the arrows in the asset pack, indexed by pattern.
+static const char *const PATTERN_ARROW_NAMES[] = {"arrow_left", "arrow_right", "arrow_up", "arrow_down"};
+
+// The art the game shows: from the asset pack when one is loaded, or built in. Set by `loadArt`.
+static const unsigned char *patternArrows[4];
+static const unsigned char *blankFrame;
+static const LedMatrixAnimation *readyAnimation;
+static const LedMatrixAnimation *incorrectAnimation;
+
+// The game's state. Only touched by the reactor's handlers, on the main thread.
+static GameState state = STATE_READY;
+static int currentLevel = 0;
+static unsigned long numInputs = 0;
+static PatternSequence expectedPattern;
+static SequenceRng rng;
+
+// Auto-play enters the expected inputs itself, for soak testing. It stops after `autoplayLevels`
+// levels, or never if that is 0, and reports its throughput as it goes.
+static int autoplay = 0;
+static unsigned long autoplayLevels = 0;
+static uint64_t autoplayStartNs = 0;
+static uint64_t reportStartNs = 0;
+
+// The timer ending the fail screen.
+static int gameTimer = -1;
+
+// Signalled on SIGINT, so the game stops from the reactor and exits through main.
+static int interruptFd = -1;
+static volatile sig_atomic_t interrupted = 0;
+
+// While a session log is replayed, the states the game enters, to be checked against the log.
+#define REPLAY_STATE_QUEUE 16
+#define REPLAY_MAX_REPORTS 5
+static int replaying = 0;
+static GameState replayStates[REPLAY_STATE_QUEUE];
+static unsigned int replayStateHead = 0;
+static unsigned int replayStateTail = 0;
+
 int main(void)
 {
 	// Initialize wiring pi
 	printf("Init Wiring Pi\n");
+	interruptFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 	signal(SIGINT, interruptHandler);
 	if (-1 == wiringPiSetup())
 	{
@@ -61,12 +202,91 @@ int main(void)
 	// Init periphs
 	printf("Init Periphs\n");
 
-	srand((unsigned)time(NULL));
+	// The patterns come from SEED when it is set, so a run can be repeated.
+	const char *seed = getenv("SEED");
+	uint64_t seedValue = seed ? strtoull(seed, NULL, 0) : (uint64_t)time(NULL);
+	sequenceRngSeed(&rng, seedValue);
+	sequenceInit(&expectedPattern);
+	printf("Pattern seed: %llu\n", (unsigned long long)seedValue);
+
+	// AUTOPLAY plays that many levels on its own, or keeps playing if it is empty or 0.
+	const char *autoplayEnv = getenv("AUTOPLAY");
+	if (autoplayEnv)
+	{
+		autoplay = 1;
+		autoplayLevels = strtoul(autoplayEnv, NULL, 0);
+	}
+
+	// REPLAY replays a session log through the game instead of playing. Otherwise SESSION_LOG
+	// appends this session to a log. Auto-play is not logged, its seed is enough to repeat it.
+	const char *replayPath = getenv("REPLAY");
+	const char *sessionPath = getenv("SESSION_LOG");
+	if (sessionPath && !replayPath && !autoplay && sessionRecordInit(sessionPath, seedValue) == 0)
+		printf("Recording the session to %s\n", sessionPath);
+
+	// Optionally drive the pins through the memory-mapped registers.
+	// GPIO_FAST may name a fake register file, otherwise /dev/gpiomem is used.
+	const char *gpioPath = getenv("GPIO_FAST");
+	if (gpioPath && gpioFastInit(*gpioPath ? gpioPath : "/dev/gpiomem") == -1)
+		printf("Falling back to wiringPi GPIO\n");
+
+	// Snapshots of the performance counters are written on SIGUSR1, and every STATS_INTERVAL_MS if set.
+	const char *statsPath = getenv("STATS_FILE");
+	const char *statsInterval = getenv("STATS_INTERVAL_MS");
+	if (statsInit(statsPath ? statsPath : DEFAULT_STATS_FILE, statsInterval ? atoi(statsInterval) : 0) == -1)
+		printf("Performance counters will not be written\n");
+
+	// Every thread's timeline is written to TRACE_FILE on exit, if it is set.
+	const char *tracePath = getenv("TRACE_FILE");
+	if (tracePath)
+		traceInit(tracePath);
+	traceThread("game");
+
+	// ASSET_PACK replaces the built-in art with a pack's, and reloads it whenever it is replaced.
+	const char *assetPath = getenv("ASSET_PACK");
+	if (assetPath && assetsInit(assetPath) == 0)
+		printf("Asset pack loaded: %lu frames\n", assetsFrameCount());
+	loadArt();
+
+	// MATRIX_PANELS chains more matrix panels, as a count in a row ("4") or a grid ("2x2").
+	const char *panels = getenv("MATRIX_PANELS");
+	if (panels && *panels)
+	{
+		int wide = 1, high = 1;
+		if (sscanf(panels, "%dx%d", &wide, &high) < 1 || ledMatrixSetLayout(wide, high) == -1)
+			printf("Ignoring MATRIX_PANELS=%s: at most %d panels\n", panels, LED_MATRIX_MAX_PANELS);
+		else
+			printf("Matrix: %dx%d pixels\n", ledMatrixWidth(), ledMatrixHeight());
+	}
+
+	// FRAME_EXPORT shares every frame shown through a shared-memory ring, which it may name.
+	const char *exportName = getenv("FRAME_EXPORT");
+	if (exportName)
+	{
+		if (!*exportName)
+			exportName = DEFAULT_FRAME_EXPORT;
+		if (frameExportInit(exportName) == 0)
+			printf("Exporting frames to %s\n", exportName);
+	}
+
 	ledMatrixInit();
 	ledBarInit();
 	buzInit();
 	joystickInit();
 
+	// Every input, timer and peripheral completion arrives through the reactor.
+	if (-1 == reactorInit() ||
+		-1 == reactorAdd(joystickEventFd(), onJoystick, NULL) ||
+		-1 == reactorAdd(ledMatrixAnimationFd(), onAnimationDone, NULL) ||
+		-1 == reactorAdd(buzDoneFd(), onBuzzerDone, NULL) ||
+		-1 == reactorAdd(interruptFd, onInterrupt, NULL) ||
+		-1 == (gameTimer = reactorAddTimer(onTimer, NULL)) ||
+		(assetsWatchFd() != -1 && -1 == reactorAddStream(assetsWatchFd(), onAssetsChanged, NULL)))
+	{
+		printf("Failed to setup the event loop!\n");
+		return 1;
+	}
+
 	printf("Success\n");
 
 	// Startup tone
@@ -75,139 +295,479 @@ int main(void)
 
 	printf("Initialized\n");
 
+	// RT_PROFILE pins the render thread to a core (RT_CPU) and makes it real-time (RT_PRIORITY),
+	// reporting its jitter before and after.
+	if (getenv("RT_PROFILE"))
+	{
+		RtProfile profile;
+		rtProfileDefaults(&profile);
+		const char *cpu = getenv("RT_CPU");
+		if (cpu)
+			profile.cpu = atoi(cpu);
+		const char *priority = getenv("RT_PRIORITY");
+		if (priority)
+			profile.priority = atoi(priority);
+
+		rtReportJitter("before", RT_JITTER_MS);
+		if (rtApply(&profile) == -1)
+			printf("RT: profile only partly applied\n");
+		rtReportJitter("after", RT_JITTER_MS);
+	}
+
+	LedMatrixStats matrixStats;
+	ledMatrixGetStats(&matrixStats);
+	printf("LED Matrix: %u/%u fps, jitter avg %uus max %uus, %lu overruns\n",
+		   matrixStats.fps, matrixStats.refreshRate, matrixStats.jitterAvgUs, matrixStats.jitterMaxUs, matrixStats.overruns);
+
+	if (replayPath)
+		return replay(replayPath);
+
 	// Game loop
-	while (1)
+	enterState(STATE_READY);
+	if (autoplay)
+		enterState(STATE_COUNTDOWN);
+	reactorRun();
+
+	sessionRecordStop();
+	return 0;
+}
+
+// Switches the game to a new state, starting whatever the state shows or plays.
+void enterState(GameState newState)
+{
+	state = newState;
+	traceInstant("game.state", state);
+	sessionRecord(SESSION_STATE, clockNowNs(), state);
+	if (replaying)
+		replayStates[replayStateHead++ % REPLAY_STATE_QUEUE] = state;
+
+	// Packs replaced earlier can go once the matrix has moved on from them.
+	assetsCollect();
+
+	switch (state)
 	{
-		// Set matrix to ready frame
-		ledMatrixSetFrame(READY);
-		delay(500);
+	case STATE_READY:
+		// Pulse the ready frame until the game starts
+		ledBarClear();
+		ledMatrixPlay(readyAnimation);
+		joystickFlushEvents();
+		break;
+
+	case STATE_COUNTDOWN:
+		printf("Starting Game\n");
+		currentLevel = 0;
+		sequenceClear(&expectedPattern);
+		statsAdd(STATS_GAMES, 1);
+		buzPlayCountdown();
+		break;
+
+	case STATE_SHOW_SEQUENCE:
+		// Get a new pattern, and show the new list of patterns. Auto-play only shows the new one.
+		if (sequenceAppend(&expectedPattern, rand_range(0, 3)) == -1 ||
+			displayPatterns(&expectedPattern, autoplay ? expectedPattern.length - 1 : 0) == -1)
+		{
+			printf("Out of memory for the sequence, ending the game.\n");
+			statsRecord(STATS_LEVEL_REACHED, currentLevel);
+			enterState(STATE_READY);
+		}
+		break;
+
+	case STATE_AWAIT_INPUT:
+		// Only inputs made after the sequence was shown count.
+		numInputs = 0;
+		joystickFlushEvents();
 
-		// Check if joystick is held down, and if so, start game.
-		if (joystickZedDown())
+		if (autoplay)
 		{
-			printf("Joystick pressed, starting game.\n");
-			game();
+			// Entering the last input moves the game on, which ends the loop.
+			for (unsigned long i = 0; state == STATE_AWAIT_INPUT && i < expectedPattern.length; i++)
+				handleInput(sequenceGet(&expectedPattern, i));
 		}
+		break;
+
+	case STATE_SUCCESS:
+		// Increase level and update outputs.
+		currentLevel++;
+		statsAdd(STATS_LEVELS, 1);
+		traceInstant("game.level", currentLevel);
+		sessionRecord(SESSION_LEVEL, clockNowNs(), currentLevel);
+		ledBarFadeRange(0, currentLevel, LED_ON, LEVEL_FADE_MS, LEVEL_FADE_MS / 2);
+
+		// Auto-play moves straight on, instead of waiting for the success tune.
+		if (autoplay)
+		{
+			reportAutoplay();
+			enterState(STATE_SHOW_SEQUENCE);
+		}
+		else
+			buzPlaySuccess();
+		break;
+
+	case STATE_FAIL:
+		ledBarFlash(0, LED_BAR_SIZE, LED_ON, 3, 440);
+		ledMatrixPlay(incorrectAnimation);
+		buzPlayIncorrect();
+		statsRecord(STATS_LEVEL_REACHED, currentLevel);
+		printStats();
+		reactorArmTimer(gameTimer, GAME_OVER_MS);
+		break;
 	}
+}
 
-	return 0;
+// Handles the joystick's queued events.
+void onJoystick(int fd, void *data)
+{
+	JoystickEvent event;
+
+	while (joystickNextEvent(&event, 0))
+		handleEvent(&event);
 }
 
-void startMenu() {}
+// Handles a joystick event the game took off the queue.
+void handleEvent(const JoystickEvent *event)
+{
+	sessionRecord(SESSION_JOYSTICK, event->timeNs, sessionPackEvent(event->type, event->dir));
 
-#define LEFT_PATTERN 0
-#define RIGHT_PATTERN 1
-#define UP_PATTERN 2
-#define DOWN_PATTERN 3
-#define INVALID_PATTERN -1
+	if (state == STATE_READY && event->type == JOY_EVENT_BUTTON_DOWN)
+	{
+		printf("Joystick pressed, starting game.\n");
+		enterState(STATE_COUNTDOWN);
+	}
+	else if (state == STATE_AWAIT_INPUT && event->type == JOY_EVENT_DIR)
+	{
+		traceBegin("game.input", event->dir);
+		handleInput(event->dir);
+		traceEnd("game.input", state);
+	}
+}
+
+// Tests an input against the pattern expected next.
+void handleInput(int input)
+{
+	int expected = sequenceGet(&expectedPattern, numInputs);
+	if (!autoplay)
+	{
+		printf("Input: %d\n", input);
+		printf("Expected: %d\n", expected);
+	}
+
+	if (expected != input)
+	{
+		enterState(STATE_FAIL);
+		return;
+	}
+
+	if (!autoplay)
+		buzPlay(PATTERN_TONES[input], PATTERN_TONE_MS);
+	numInputs++;
+
+	if (numInputs == expectedPattern.length)
+		enterState(STATE_SUCCESS);
+}
+
+// Moves on once the sequence has been shown.
+void onAnimationDone(int fd, void *data)
+{
+	if (ledMatrixAnimationDone())
+		sequenceShown();
+}
+
+// Moves on once the countdown or success tune has finished.
+void onBuzzerDone(int fd, void *data)
+{
+	if (buzDone())
+		tuneDone();
+}
+
+// Ends the fail screen.
+void onTimer(int fd, void *data)
+{
+	gameOverDone();
+}
+
+// Waits for the player's input once the sequence has finished showing.
+void sequenceShown()
+{
+	if (state != STATE_SHOW_SEQUENCE)
+		return;
+
+	sessionRecord(SESSION_SEQUENCE_SHOWN, clockNowNs(), 0);
+	enterState(STATE_AWAIT_INPUT);
+}
+
+// Shows the next sequence once the countdown or success tune has finished.
+void tuneDone()
+{
+	if (state != STATE_COUNTDOWN && state != STATE_SUCCESS)
+		return;
 
-void game()
+	sessionRecord(SESSION_TUNE_DONE, clockNowNs(), 0);
+	enterState(STATE_SHOW_SEQUENCE);
+}
+
+// Gets ready for the next game once the fail screen has timed out.
+void gameOverDone()
 {
-	printf("Starting Game\n");
-	buzPlayCountdown();
+	if (state != STATE_FAIL)
+		return;
 
-	int currentLevel = 0;
-	int patternIndex = 0;
-	int expectedPattern[20] = {INVALID_PATTERN};
+	sessionRecord(SESSION_GAME_OVER_DONE, clockNowNs(), 0);
+	enterState(STATE_READY);
+}
+
+// Replays the sessions in the log at `path` through the game's handlers, as fast as they run, and
+// checks that the game enters the states and reaches the levels that were logged.
+// Returns the exit status: 0 if every session replayed the same, or 1 otherwise.
+int replay(const char *path)
+{
+	SessionReader reader;
+	if (sessionOpen(&reader, path) == -1)
+		return 1;
 
-	while (1)
+	replaying = 1;
+	unsigned long records = 0;
+	unsigned long inputs = 0;
+	unsigned long sessions = 0;
+	unsigned long divergences = 0;
+	uint64_t sessionStartNs = 0;
+	uint64_t sessionLastNs = 0;
+	uint64_t recordedNs = 0;
+	uint64_t start = threadCpuNs();
+
+	SessionRecord record;
+	int result = 0;
+	while (!interrupted && (result = sessionRead(&reader, &record)) == 1)
 	{
-		// Get a new pattern
-		int newPattern = rand_range(0, 3);
-		expectedPattern[patternIndex] = newPattern;
-		patternIndex++;
+		records++;
+		int diverged = 0;
+		long expected = 0;
+		long actual = 0;
 
-		// Show new list of patterns
-		// TODO: Sound effects, increasing speed.
-		for (int i = 0; i < patternIndex; i++)
+		switch (record.type)
 		{
-			displayPattern(expectedPattern[i]);
+		case SESSION_START:
+			// The game is back to its initial state, with the session's seed.
+			recordedNs += sessionLastNs - sessionStartNs;
+			sessions++;
+			sessionStartNs = sessionLastNs = record.timeNs;
+			printf("Replaying session %lu, pattern seed %llu\n", sessions, (unsigned long long)record.value);
+			sequenceRngSeed(&rng, record.value);
+			replayStateTail = replayStateHead;
+			enterState(STATE_READY);
+			break;
 
-			// Play tone
-			// TODO: This *might* cause issues because of the delays, we may need to run buzzer in a separate thread.
-			// TODO: Individual tones for each direction.
-			buzPlay(880, 50);
+		case SESSION_JOYSTICK:
+		{
+			int type, dir;
+			sessionUnpackEvent(record.value, &type, &dir);
+			JoystickEvent event = {(JoystickEventType)type, dir, record.timeNs};
+			handleEvent(&event);
+			inputs++;
+			break;
+		}
 
-			// Delay between showing each pattern.
-			// TODO: Increase this based on level.
-			delay(500);
+		case SESSION_SEQUENCE_SHOWN:
+			sequenceShown();
+			break;
+
+		case SESSION_TUNE_DONE:
+			tuneDone();
+			break;
+
+		case SESSION_GAME_OVER_DONE:
+			gameOverDone();
+			break;
+
+		case SESSION_STATE:
+			expected = record.value;
+			actual = replayStateTail == replayStateHead ? -1 : (long)replayStates[replayStateTail++ % REPLAY_STATE_QUEUE];
+			diverged = expected != actual;
+			break;
+
+		case SESSION_LEVEL:
+			expected = record.value;
+			actual = currentLevel;
+			diverged = expected != actual;
+			break;
 		}
 
-		ledMatrixSetFrame(BLANK);
+		if (record.timeNs > sessionLastNs)
+			sessionLastNs = record.timeNs;
 
-		// Test user's pattern memory skill
-		int failed = 0;
-		int numInputs = 0;
+		if (diverged && divergences++ < REPLAY_MAX_REPORTS)
+			printf("Replay diverged at record %lu (%.3fs into session %lu): logged %s %ld, replayed %ld\n", records,
+				   (record.timeNs - sessionStartNs) / 1e9, sessions, record.type == SESSION_STATE ? "state" : "level",
+				   expected, actual);
+	}
+
+	sessionClose(&reader);
+	double elapsedS = (threadCpuNs() - start) / 1e9;
+
+	if (result == -1)
+		printf("Session log %s is corrupt after record %lu\n", path, records);
+
+	recordedNs += sessionLastNs - sessionStartNs;
+	printf("Replayed %lu sessions (%.1fs of play), %lu records (%lu inputs) in %.1fms, %.0f records/s, %lu divergences\n",
+		   sessions, recordedNs / 1e9, records, inputs, elapsedS * 1e3, elapsedS > 0 ? records / elapsedS : 0, divergences);
+
+	return divergences || result == -1 ? 1 : 0;
+}
 
-		while (numInputs < patternIndex)
+// Returns the CPU time the calling thread has used, in nanoseconds. Replay is timed on it, so the
+// rate it reports counts the decoding work alone.
+uint64_t threadCpuNs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Prints the peripherals' statistics for the game that just ended.
+void printStats()
+{
+	JoystickStats joystickStats;
+	joystickGetStats(&joystickStats);
+	printf("Joystick: %lu samples (%lu rejected), input latency avg %uus max %uus, %lu missed flicks, %lu dropped events\n",
+		   joystickStats.samples, joystickStats.adcRejects, joystickStats.latencyAvgUs, joystickStats.latencyMaxUs,
+		   joystickStats.missedFlicks, joystickStats.eventsDropped);
+
+	LedBarStats barStats;
+	ledBarGetStats(&barStats);
+	printf("LED Bar: %lu frames, %lu bytes pushed, %lums bus time\n",
+		   barStats.frames, barStats.bytesPushed, barStats.busTimeUs / 1000);
+}
+
+// Plays the arrow LED matrix animation and the tones for the patterns from `first` on. Returns immediately.
+// Each arrow slides in the direction it points, then fades out, with its tone playing as it slides in.
+// Auto-play cuts each arrow in and out silently instead, as fast as the matrix can show it.
+// Returns 0 on success, or -1 if there was no memory to show any of the patterns.
+int displayPatterns(const PatternSequence *patterns, unsigned long first)
+{
+	unsigned long count = patterns->length - first;
+
+	// The previous sequence has finished playing by now, so its buffers can move.
+	if (count > displayCapacity)
+	{
+		unsigned long capacity = displayCapacity ? displayCapacity : 16;
+		while (capacity < count)
+			capacity *= 2;
+
+		LedMatrixKeyframe *keyframes = realloc(sequenceKeyframes, capacity * 2 * sizeof(LedMatrixKeyframe));
+		if (keyframes)
+			sequenceKeyframes = keyframes;
+		BuzNote *notes = realloc(sequenceNotes, capacity * sizeof(BuzNote));
+		if (notes)
+			sequenceNotes = notes;
+
+		// Without room for the whole sequence, show as much of it as the old buffers hold.
+		if (keyframes && notes)
+			displayCapacity = capacity;
+		else if (!displayCapacity)
+			return -1;
+		else
 		{
-			// Wait for joystick input
-			int input = joystickWaitForDir();
-			printf("Input: %d\n", input);
-			printf("Expected: %d\n", expectedPattern[numInputs]);
-
-			// Test if input is correct
-			if (expectedPattern[numInputs] != input)
-			{
-				failed = 1;
-				break;
-			}
-
-			numInputs++;
-			joystickWaitForCenter();
+			printf("Out of memory for the sequence display, showing the first %lu patterns\n", displayCapacity);
+			count = displayCapacity;
 		}
+	}
+
+	for (unsigned long i = 0; i < count; i++)
+	{
+		int pattern = sequenceGet(patterns, first + i);
+		LedMatrixKeyframe *arrow = &sequenceKeyframes[i * 2];
+		LedMatrixKeyframe *gap = &sequenceKeyframes[i * 2 + 1];
 
-		if (failed)
+		if (autoplay)
 		{
-			// TODO: Failed led effect.
-			ledBarClear();
-			ledMatrixSetFrame(INCORRECT);
-			buzPlayIncorrect();
-			break;
+			*arrow = (LedMatrixKeyframe){patternArrows[pattern], LED_MATRIX_CUT, 0, AUTOPLAY_STEP_MS};
+			*gap = (LedMatrixKeyframe){blankFrame, LED_MATRIX_CUT, 0, 0};
+			continue;
 		}
 
-		// Success! Increase level and update outputs.
-		currentLevel++;
-		buzPlaySuccess();
+		printf("Showing pattern %d\n", pattern);
+		*arrow = (LedMatrixKeyframe){patternArrows[pattern], PATTERN_SLIDES[pattern], PATTERN_SLIDE_MS, PATTERN_HOLD_MS};
+		*gap = (LedMatrixKeyframe){blankFrame, LED_MATRIX_FADE, PATTERN_FADE_MS, 0};
+		sequenceNotes[i] = (BuzNote){PATTERN_TONES[pattern], PATTERN_TONE_MS, PATTERN_STEP_MS - PATTERN_TONE_MS};
+	}
+
+	sequenceAnimation.keyframes = sequenceKeyframes;
+	sequenceAnimation.count = (int)count * 2;
+	ledMatrixPlay(&sequenceAnimation);
 
-		for (int i = 0; i < currentLevel; i++)
-			ledBarSet(i, LED_ON);
+	if (!autoplay)
+		buzPlayNotes(sequenceNotes, (int)count);
+
+	return 0;
+}
 
-		// TODO: Max level (10) handling.
+// Prints auto-play's throughput every AUTOPLAY_REPORT_LEVELS levels, and ends the run once it
+// has played the levels it was asked to.
+void reportAutoplay()
+{
+	uint64_t now = clockNowNs();
+	if (currentLevel == 1)
+		autoplayStartNs = reportStartNs = now;
+
+	int finished = autoplayLevels && (unsigned long)currentLevel >= autoplayLevels;
+	if (currentLevel % AUTOPLAY_REPORT_LEVELS != 0 && !finished)
+		return;
+
+	unsigned long window = currentLevel % AUTOPLAY_REPORT_LEVELS ? currentLevel % AUTOPLAY_REPORT_LEVELS : AUTOPLAY_REPORT_LEVELS;
+	double windowS = (now - reportStartNs) / 1e9;
+	double totalS = (now - autoplayStartNs) / 1e9;
+	printf("Auto-play: level %d, %.1f levels/s (last %lu), %.1f levels/s overall, sequence %lu bytes\n", currentLevel,
+		   windowS > 0 ? window / windowS : 0, window, totalS > 0 ? (currentLevel - 1) / totalS : 0,
+		   sequenceBytes(&expectedPattern));
+	reportStartNs = now;
+
+	if (finished)
+	{
+		printStats();
+		exit(0);
 	}
+}
 
-	delay(3000);
-	ledBarClear();
+// Looks up the art the game shows in the asset pack, falling back to the built-in art.
+void loadArt()
+{
+	for (int i = 0; i < 4; i++)
+		patternArrows[i] = assetsFrame(PATTERN_ARROW_NAMES[i], PATTERN_ARROWS[i]);
+
+	blankFrame = assetsFrame("blank", BLANK_BITS);
+	readyAnimation = assetsAnimation("ready", &READY_ANIMATION);
+	incorrectAnimation = assetsAnimation("incorrect", &INCORRECT_ANIMATION);
 }
 
-// Displays an arrow LED matrix frame based on supplied pattern.
-void displayPattern(int pattern)
+// Swaps in the asset pack when it is replaced, showing the new art right away when idle.
+void onAssetsChanged(int fd, void *data)
 {
-	printf("Showing pattern %d\n", pattern);
-	switch (pattern)
+	if (assetsReload() == 1)
 	{
-	case 0:
-		ledMatrixSetFrame(ARROW_LEFT);
-		break;
-	case 1:
-		ledMatrixSetFrame(ARROW_RIGHT);
-		break;
-	case 2:
-		ledMatrixSetFrame(ARROW_UP);
-		break;
-	case 3:
-		ledMatrixSetFrame(ARROW_DOWN);
-		break;
+		loadArt();
+		if (state == STATE_READY)
+			ledMatrixPlay(readyAnimation);
 	}
+
+	assetsCollect();
 }
 
+// Returns a random number from `min` to `max`, inclusive.
 int rand_range(int min, int max)
 {
-	int num_numbers = max - min + 1;
-	return (rand() % num_numbers) + min;
+	return sequenceRngRange(&rng, min, max);
+}
+
+// Stops the game once SIGINT has been caught, so main returns and the exit handlers run as usual.
+void onInterrupt(int fd, void *data)
+{
+	reactorStop();
 }
 
+// Handles SIGINT. Only wakes the reactor, since exiting runs handlers that are not async-signal-safe.
 void interruptHandler(const int _signal)
 {
-	exit(0);
+	uint64_t one = 1;
+	interrupted = 1;
+	if (write(interruptFd, &one, sizeof(one)) == -1)
+		return;
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+
+A single-threaded event loop for the game thread.
+
+Most sources are eventfds or timerfds, so the reactor reads (and so resets) their counter before
+calling their handler. Handlers then look at the state behind the fd, for instance by draining the
+joystick's event queue. Other fds, like inotify's, are added as streams and drained by their handler.
+The thread sleeps in epoll_wait whenever nothing is pending.
+
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "reactor.h"
+
+// The most fds the reactor can watch.
+#define MAX_SOURCES 16
+
+typedef struct
+{
+    int fd;
+    ReactorHandler handler;
+    void *data;
+    int stream;
+} Source;
+
+static int epollFd = -1;
+static Source sources[MAX_SOURCES];
+static int sourceCount = 0;
+static int running = 0;
+
+static int addSource(int fd, ReactorHandler handler, void *data, int stream);
+
+// Creates the reactor. Returns -1 on failure.
+int reactorInit()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Calls `handler` whenever the eventfd or timerfd `fd` becomes readable, after resetting its
+// counter. Returns -1 on failure.
+int reactorAdd(int fd, ReactorHandler handler, void *data)
+{
+    return addSource(fd, handler, data, 0);
+}
+
+// Calls `handler` whenever `fd` becomes readable, leaving the reading to the handler.
+// Returns -1 on failure.
+int reactorAddStream(int fd, ReactorHandler handler, void *data)
+{
+    return addSource(fd, handler, data, 1);
+}
+
+// Creates a one-shot timer that calls `handler` when it expires. Returns the timer's fd, or -1 on failure.
+int reactorAddTimer(ReactorHandler handler, void *data)
+{
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd == -1)
+    {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    if (reactorAdd(timerFd, handler, data) == -1)
+    {
+        close(timerFd);
+        return -1;
+    }
+
+    return timerFd;
+}
+
+// Arms a timer to expire in `ms` milliseconds, replacing any earlier expiry. 0 disarms it.
+void reactorArmTimer(int timerFd, unsigned int ms)
+{
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+
+    timerfd_settime(timerFd, 0, &spec, NULL);
+}
+
+// Dispatches events until `reactorStop` is called from a handler.
+void reactorRun()
+{
+    struct epoll_event events[MAX_SOURCES];
+
+    running = 1;
+    while (running)
+    {
+        int count = epoll_wait(epollFd, events, MAX_SOURCES, -1);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < count && running; i++)
+        {
+            Source *source = events[i].data.ptr;
+
+            // A timer disarmed after it became readable has nothing left to read; skip it.
+            uint64_t counter;
+            if (!source->stream && read(source->fd, &counter, sizeof(counter)) == -1)
+                continue;
+
+            source->handler(source->fd, source->data);
+        }
+    }
+}
+
+// Makes `reactorRun` return once the current handler does.
+void reactorStop()
+{
+    running = 0;
+}
+
+// Watches `fd` for `handler`. Returns -1 on failure.
+static int addSource(int fd, ReactorHandler handler, void *data, int stream)
+{
+    if (fd == -1 || sourceCount == MAX_SOURCES)
+        return -1;
+
+    Source *source = &sources[sourceCount];
+    source->fd = fd;
+    source->handler = handler;
+    source->data = data;
+    source->stream = stream;
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = source};
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    sourceCount++;
+    return 0;
+}
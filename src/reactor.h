@@ -0,0 +1,16 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+// Called with the fd that became readable, after its eventfd or timerfd counter was read.
+// Streams are left for the handler to read.
+typedef void (*ReactorHandler)(int fd, void *data);
+
+int reactorInit();
+int reactorAdd(int fd, ReactorHandler handler, void *data);
+int reactorAddStream(int fd, ReactorHandler handler, void *data);
+int reactorAddTimer(ReactorHandler handler, void *data);
+void reactorArmTimer(int timerFd, unsigned int ms);
+void reactorRun();
+void reactorStop();
+
+#endif
@@ -0,0 +1,203 @@
+/*
+
+A real-time runtime profile for the render thread, which flickers whenever it is scheduled late.
+
+Applying the profile:
+- locks the process's memory, so no page fault can stall a scan,
+- pre-faults the top of the render and game threads' stacks, so they are resident once locked,
+- pins the render thread to one core (an isolated one if the kernel has any), and moves the game
+  thread off it,
+- and runs the render thread under SCHED_FIFO, so ordinary threads cannot preempt it.
+
+Every step needs privileges the process may not have (root, or CAP_SYS_NICE and CAP_IPC_LOCK). A
+step that fails is reported and skipped, and the game runs on with whatever did apply.
+
+The jitter report samples the render thread's recent scan periods and prints their percentiles, so
+the effect of the profile can be measured on the spot.
+
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "clock.h"
+#include "led_matrix.h"
+#include "rt.h"
+
+// The SCHED_FIFO priority of the render thread, unless the profile says otherwise.
+#define DEFAULT_PRIORITY 80
+
+// How much of each thread's stack is pre-faulted, in bytes.
+#define STACK_PREFAULT_BYTES (64 * 1024)
+
+// The most scan periods a jitter report looks at.
+#define JITTER_SAMPLES 1024
+
+static int pickCpu();
+static int prefaultStack(pthread_t thread, const char *name);
+static int comparePeriods(const void *a, const void *b);
+
+// Fills `profile` with the defaults: any isolated core, at the default priority.
+void rtProfileDefaults(RtProfile *profile)
+{
+    profile->cpu = -1;
+    profile->priority = DEFAULT_PRIORITY;
+}
+
+// Applies the profile to the running process. Returns 0 if every step applied, or -1 if any
+// fell back for lack of privileges or support.
+int rtApply(const RtProfile *profile)
+{
+    int result = 0;
+    pthread_t renderThread = ledMatrixRenderThread();
+
+    // Only lock pages as they are faulted in, so the untouched parts of every thread's stack
+    // mapping are not pulled into memory.
+#ifdef MCL_ONFAULT
+    int lockFlags = MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT;
+#else
+    int lockFlags = MCL_CURRENT | MCL_FUTURE;
+#endif
+    if (mlockall(lockFlags) == 0)
+        printf("RT: memory locked\n");
+    else
+    {
+        printf("RT: could not lock memory (%s), page faults may stall the render thread\n", strerror(errno));
+        result = -1;
+    }
+
+    if (prefaultStack(renderThread, "render") == -1 || prefaultStack(pthread_self(), "game") == -1)
+        result = -1;
+
+    int cpu = profile->cpu >= 0 ? profile->cpu : pickCpu();
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    cpu_set_t renderSet;
+    CPU_ZERO(&renderSet);
+    CPU_SET(cpu, &renderSet);
+
+    int error = pthread_setaffinity_np(renderThread, sizeof(renderSet), &renderSet);
+    if (error == 0)
+    {
+        printf("RT: render thread pinned to CPU %d\n", cpu);
+
+        // Keep the game thread off the render core, unless it is the only one.
+        cpu_set_t otherSet;
+        CPU_ZERO(&otherSet);
+        for (int i = 0; i < cpus; i++)
+        {
+            if (i != cpu)
+                CPU_SET(i, &otherSet);
+        }
+        if (cpus > 1)
+            pthread_setaffinity_np(pthread_self(), sizeof(otherSet), &otherSet);
+    }
+    else
+    {
+        printf("RT: could not pin the render thread to CPU %d (%s)\n", cpu, strerror(error));
+        result = -1;
+    }
+
+    struct sched_param param = {.sched_priority = profile->priority};
+    error = pthread_setschedparam(renderThread, SCHED_FIFO, &param);
+    if (error == 0)
+        printf("RT: render thread running SCHED_FIFO at priority %d\n", profile->priority);
+    else
+    {
+        printf("RT: could not make the render thread real-time (%s), it keeps the default policy\n", strerror(error));
+        result = -1;
+    }
+
+    return result;
+}
+
+// Waits `windowMs` for the render thread to scan, then prints the percentiles of its recent scan
+// periods under `label`.
+void rtReportJitter(const char *label, unsigned int windowMs)
+{
+    clockSleepUntilNs(clockNowNs() + windowMs * 1000000ULL);
+
+    LedMatrixStats stats;
+    ledMatrixGetStats(&stats);
+
+    // Only look at the scans made during the window.
+    unsigned long windowScans = (unsigned long)windowMs * stats.refreshRate / 1000;
+    static unsigned int periods[JITTER_SAMPLES];
+    int count = ledMatrixGetScanPeriods(periods, windowScans < JITTER_SAMPLES ? (int)windowScans : JITTER_SAMPLES);
+    if (count == 0)
+    {
+        printf("Scan period %s: no scans yet\n", label);
+        return;
+    }
+
+    qsort(periods, count, sizeof(unsigned int), comparePeriods);
+
+    printf("Scan period %s: p50 %uus, p90 %uus, p99 %uus, p99.9 %uus, max %uus (nominal %uus, %d scans)\n", label,
+           periods[count * 50 / 100] / 1000, periods[count * 90 / 100] / 1000, periods[count * 99 / 100] / 1000,
+           periods[count * 999 / 1000] / 1000, periods[count - 1] / 1000, 1000000 / stats.refreshRate, count);
+}
+
+// Returns the first isolated core, or the last core if none are isolated.
+static int pickCpu()
+{
+    FILE *file = fopen("/sys/devices/system/cpu/isolated", "r");
+    if (file)
+    {
+        int cpu;
+        int found = fscanf(file, "%d", &cpu) == 1;
+        fclose(file);
+
+        if (found)
+            return cpu;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus - 1 : 0;
+}
+
+// Faults in the top of a thread's stack, where it runs. The pages are populated without being
+// written, so this is safe on a running thread. Returns 0 on success, or -1 if it is unsupported.
+static int prefaultStack(pthread_t thread, const char *name)
+{
+#ifdef MADV_POPULATE_WRITE
+    pthread_attr_t attr;
+    void *stack;
+    size_t size;
+
+    if (pthread_getattr_np(thread, &attr) != 0)
+        return -1;
+    int error = pthread_attr_getstack(&attr, &stack, &size);
+    pthread_attr_destroy(&attr);
+    if (error != 0)
+        return -1;
+
+    size_t bytes = size < STACK_PREFAULT_BYTES ? size : STACK_PREFAULT_BYTES;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    unsigned long top = (unsigned long)stack + size;
+    unsigned long start = (top - bytes) & ~(unsigned long)(pageSize - 1);
+
+    if (madvise((void *)start, top - start, MADV_POPULATE_WRITE) == 0)
+        return 0;
+
+    printf("RT: could not pre-fault the %s thread's stack (%s)\n", name, strerror(errno));
+    return -1;
+#else
+    printf("RT: pre-faulting the %s thread's stack is not supported here\n", name);
+    return -1;
+#endif
+}
+
+static int comparePeriods(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,15 @@
+#ifndef RT_H
+#define RT_H
+
+// How the render thread is scheduled. A `cpu` of -1 picks one, preferring an isolated core.
+typedef struct
+{
+    int cpu;
+    int priority;
+} RtProfile;
+
+void rtProfileDefaults(RtProfile *profile);
+int rtApply(const RtProfile *profile);
+void rtReportJitter(const char *label, unsigned int windowMs);
+
+#endif
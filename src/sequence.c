@@ -0,0 +1,126 @@
+/*
+
+Storage and generation of the pattern sequence the player repeats.
+
+There are only four patterns, so each step takes 2 bits and four steps share a byte. The buffer
+doubles whenever it fills up, so appending a step is amortized constant time, and a sequence a
+thousand levels long still takes a quarter of a kilobyte. Clearing a sequence keeps its buffer, so
+a new game does not allocate again.
+
+Patterns are drawn from a xorshift64* generator instead of `rand`. It is a few instructions per
+number, keeps no hidden global state, and is seeded explicitly, so a run can be reproduced from its
+seed. Ranges are mapped with a multiply and a shift instead of `rand() % n`'s divide. On its own
+that still favours some results slightly whenever the span does not divide 2^32, so the few draws
+that would cause it are thrown away (Lemire's method). Four divides 2^32, so drawing a pattern
+never throws a draw away.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sequence.h"
+
+// How many steps the buffer starts with. Must be a multiple of 4.
+#define INITIAL_CAPACITY 64
+
+// Starts an empty sequence. Nothing is allocated until the first step is appended.
+void sequenceInit(PatternSequence *sequence)
+{
+    sequence->packed = NULL;
+    sequence->length = 0;
+    sequence->capacity = 0;
+}
+
+// Frees the sequence's buffer, leaving it empty.
+void sequenceFree(PatternSequence *sequence)
+{
+    free(sequence->packed);
+    sequenceInit(sequence);
+}
+
+// Empties the sequence, keeping its buffer for the next one.
+void sequenceClear(PatternSequence *sequence)
+{
+    sequence->length = 0;
+}
+
+// Appends a pattern (0 to 3) to the sequence.
+// Returns 0 on success, or -1 if the buffer could not grow.
+int sequenceAppend(PatternSequence *sequence, int pattern)
+{
+    if (sequence->length == sequence->capacity)
+    {
+        unsigned long capacity = sequence->capacity ? sequence->capacity * 2 : INITIAL_CAPACITY;
+        unsigned char *packed = realloc(sequence->packed, capacity / 4);
+        if (!packed)
+            return -1;
+
+        memset(packed + sequence->capacity / 4, 0, (capacity - sequence->capacity) / 4);
+        sequence->packed = packed;
+        sequence->capacity = capacity;
+    }
+
+    unsigned long index = sequence->length++;
+    int shift = (index % 4) * 2;
+    unsigned char *byte = &sequence->packed[index / 4];
+    *byte = (*byte & ~(3 << shift)) | (pattern & 3) << shift;
+
+    return 0;
+}
+
+// Returns the pattern at `index`, which must be less than the sequence's length.
+int sequenceGet(const PatternSequence *sequence, unsigned long index)
+{
+    return sequence->packed[index / 4] >> (index % 4) * 2 & 3;
+}
+
+// Returns how many bytes the sequence's buffer takes.
+unsigned long sequenceBytes(const PatternSequence *sequence)
+{
+    return sequence->capacity / 4;
+}
+
+// Seeds the generator. Any seed works, including 0.
+void sequenceRngSeed(SequenceRng *rng, uint64_t seed)
+{
+    // Run the seed through splitmix64, so similar seeds give unrelated sequences and the state is
+    // never 0, which xorshift cannot leave.
+    uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+
+    rng->state = z ? z : 0x9e3779b97f4a7c15ULL;
+}
+
+// Returns the next 32 random bits.
+uint32_t sequenceRngNext(SequenceRng *rng)
+{
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+
+    return (uint32_t)((x * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+// Returns a random number from `min` to `max`, inclusive, with every number equally likely.
+int sequenceRngRange(SequenceRng *rng, int min, int max)
+{
+    uint32_t span = (uint32_t)(max - min) + 1;
+    if (span == 0)
+        return (int)sequenceRngNext(rng);
+
+    // The low half of the product only falls below 2^32 % span for the draws that bias the result.
+    uint64_t product = (uint64_t)sequenceRngNext(rng) * span;
+    if ((uint32_t)product < span)
+    {
+        uint32_t threshold = -span % span;
+        while ((uint32_t)product < threshold)
+            product = (uint64_t)sequenceRngNext(rng) * span;
+    }
+
+    return min + (int)(product >> 32);
+}
@@ -0,0 +1,31 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <stdint.h>
+
+// A growable list of patterns, each packed into 2 bits, so a sequence of any length fits.
+typedef struct
+{
+    unsigned char *packed;
+    unsigned long length;
+    unsigned long capacity;
+} PatternSequence;
+
+// A xorshift64* generator. Fast, and the same seed always gives the same patterns.
+typedef struct
+{
+    uint64_t state;
+} SequenceRng;
+
+void sequenceInit(PatternSequence *sequence);
+void sequenceFree(PatternSequence *sequence);
+void sequenceClear(PatternSequence *sequence);
+int sequenceAppend(PatternSequence *sequence, int pattern);
+int sequenceGet(const PatternSequence *sequence, unsigned long index);
+unsigned long sequenceBytes(const PatternSequence *sequence);
+
+void sequenceRngSeed(SequenceRng *rng, uint64_t seed);
+uint32_t sequenceRngNext(SequenceRng *rng);
+int sequenceRngRange(SequenceRng *rng, int min, int max);
+
+#endif
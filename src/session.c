@@ -0,0 +1,286 @@
+/*
+
+A compact, append-only log of game sessions, for reproducing them exactly.
+
+A session starts with the pattern seed, then logs everything that moves the game on: each joystick
+event the game takes off the queue, and each sequence, tune or fail screen that finishes. Given the
+seed, those inputs in that order fully determine the game, so replaying them through the game's own
+handlers reproduces the session. The states the game entered and the levels reached are logged too,
+so a replay can check that it stayed on the same path.
+
+Recording only costs the game thread a few stores: records go into a ring, and a writer thread
+encodes and appends them every SESSION_FLUSH_MS, or sooner when the ring fills up. Records that do
+not fit in the ring are dropped and counted. Whatever is left is written when recording stops: main
+stops it once the game loop returns, and an atexit handler stops it if the program exits elsewhere.
+
+On disk, each session starts with "MGSR" and a version byte. Every record is a type byte, then the
+time since the previous record in microseconds and its value, both as varints; the time is zigzag
+encoded because joystick events carry the time they were sampled, which may precede the record
+before them. The first record's time is absolute. Most records take 3 or 4 bytes.
+
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "clock.h"
+#include "session.h"
+#include "trace.h"
+
+#define SESSION_MAGIC "MGSR"
+#define SESSION_VERSION 1
+
+// How many records can wait for the writer. Must be a power of two.
+#define SESSION_RING_SIZE 1024
+
+// How often the writer appends waiting records, in milliseconds.
+#define SESSION_FLUSH_MS 100
+
+// How many encoded bytes the writer gathers before appending them.
+#define SESSION_BUFFER_SIZE 4096
+
+// The longest a record can be encoded in: the magic, version and type, and two varints.
+#define SESSION_MAX_RECORD 26
+
+static void *writeRecords(void *arg);
+static size_t encode(unsigned char *out, const SessionRecord *record, uint64_t *lastNs);
+static size_t putVarint(unsigned char *out, uint64_t value);
+static int getVarint(FILE *file, uint64_t *value);
+
+// Records from the game thread (producer) to the writer thread (consumer).
+static SessionRecord ring[SESSION_RING_SIZE];
+static atomic_uint ringHead = 0;
+static atomic_uint ringTail = 0;
+static atomic_ulong dropped = 0;
+
+static atomic_int recording = 0;
+static atomic_int stopping = 0;
+static int logFd = -1;
+static int wakeFd = -1;
+static pthread_t writer;
+
+// Starts a session with `seed` at the end of the log at `path`, and records into it until exit.
+// Returns 0 on success, or -1 if the log could not be opened.
+int sessionRecordInit(const char *path, uint64_t seed)
+{
+    logFd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd == -1)
+    {
+        perror("Failed to open session log");
+        return -1;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd == -1 || pthread_create(&writer, NULL, writeRecords, NULL) != 0)
+    {
+        printf("Failed to start the session writer\n");
+        close(logFd);
+        return -1;
+    }
+
+    atexit(sessionRecordStop);
+    atomic_store(&recording, 1);
+    sessionRecord(SESSION_START, clockNowNs(), seed);
+    return 0;
+}
+
+// Queues a record for the log. Only called by the game thread; does nothing when not recording.
+void sessionRecord(SessionRecordType type, uint64_t timeNs, uint64_t value)
+{
+    if (!atomic_load_explicit(&recording, memory_order_relaxed))
+        return;
+
+    unsigned int head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+    unsigned int waiting = head - atomic_load_explicit(&ringTail, memory_order_acquire);
+    if (waiting == SESSION_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    ring[head % SESSION_RING_SIZE] = (SessionRecord){type, timeNs, value};
+    atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+
+    // Wake the writer early rather than let a burst fill the ring.
+    if (waiting + 1 == SESSION_RING_SIZE / 2)
+    {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) == -1)
+            return;
+    }
+}
+
+// Opens the log at `path` for reading. Returns 0 on success, or -1 if it could not be opened.
+int sessionOpen(SessionReader *reader, const char *path)
+{
+    reader->file = fopen(path, "rb");
+    reader->timeNs = 0;
+    if (!reader->file)
+    {
+        perror("Failed to open session log");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Reads the next record of the log.
+// Returns 1 if a record was read, 0 at the end of the log, or -1 if the log is corrupt.
+int sessionRead(SessionReader *reader, SessionRecord *record)
+{
+    int type = getc(reader->file);
+    if (type == EOF)
+        return 0;
+
+    // A new session: check its magic and version, and start its clock over.
+    if (type == SESSION_MAGIC[0])
+    {
+        char magic[sizeof(SESSION_MAGIC) - 1];
+        magic[0] = type;
+        if (fread(magic + 1, 1, sizeof(magic) - 1, reader->file) != sizeof(magic) - 1 ||
+            memcmp(magic, SESSION_MAGIC, sizeof(magic)) != 0 || getc(reader->file) != SESSION_VERSION)
+            return -1;
+
+        reader->timeNs = 0;
+        type = getc(reader->file);
+    }
+
+    uint64_t delta;
+    uint64_t value;
+    if (type < 0 || type > SESSION_LEVEL || getVarint(reader->file, &delta) == -1 || getVarint(reader->file, &value) == -1)
+        return -1;
+
+    // Undo the zigzag encoding.
+    int64_t deltaUs = (int64_t)(delta >> 1) ^ -(int64_t)(delta & 1);
+    reader->timeNs += deltaUs * 1000;
+
+    record->type = type;
+    record->timeNs = reader->timeNs;
+    record->value = value;
+    return 1;
+}
+
+void sessionClose(SessionReader *reader)
+{
+    fclose(reader->file);
+}
+
+// Encodes and appends queued records until the program exits.
+static void *writeRecords(void *arg)
+{
+    traceThread("session");
+
+    unsigned char buffer[SESSION_BUFFER_SIZE];
+    uint64_t lastNs = 0;
+
+    while (1)
+    {
+        struct pollfd fd = {.fd = wakeFd, .events = POLLIN};
+        uint64_t count;
+        if (clockPoll(&fd, 1, SESSION_FLUSH_MS * 1000000LL) > 0 && read(wakeFd, &count, sizeof(count)) == -1)
+            continue;
+
+        // Read `stopping` before draining, so nothing queued before the stop is left behind.
+        int stop = atomic_load_explicit(&stopping, memory_order_acquire);
+
+        size_t length = 0;
+        unsigned int tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&ringHead, memory_order_acquire);
+        while (tail != head)
+        {
+            length += encode(buffer + length, &ring[tail % SESSION_RING_SIZE], &lastNs);
+            atomic_store_explicit(&ringTail, ++tail, memory_order_release);
+
+            if (length > SESSION_BUFFER_SIZE - SESSION_MAX_RECORD || tail == head)
+            {
+                if (write(logFd, buffer, length) != (ssize_t)length)
+                    perror("Failed to write session log");
+                length = 0;
+            }
+        }
+
+        if (stop)
+            break;
+    }
+
+    return NULL;
+}
+
+// Stops recording, writes whatever is still queued, and reports records that were dropped.
+// Does nothing if the session is not being recorded.
+void sessionRecordStop()
+{
+    if (!atomic_exchange_explicit(&recording, 0, memory_order_relaxed))
+        return;
+
+    atomic_store_explicit(&stopping, 1, memory_order_release);
+
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) != -1)
+        pthread_join(writer, NULL);
+
+    unsigned long lost = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (lost)
+        printf("Session log: %lu records dropped\n", lost);
+    close(logFd);
+}
+
+// Encodes a record into `out`, returning its length. `lastNs` is the time of the previous record.
+static size_t encode(unsigned char *out, const SessionRecord *record, uint64_t *lastNs)
+{
+    size_t length = 0;
+
+    if (record->type == SESSION_START)
+    {
+        memcpy(out, SESSION_MAGIC, sizeof(SESSION_MAGIC) - 1);
+        length = sizeof(SESSION_MAGIC) - 1;
+        out[length++] = SESSION_VERSION;
+        *lastNs = 0;
+    }
+
+    // Times are kept to the microsecond, rounding towards the previous record.
+    int64_t deltaUs = ((int64_t)record->timeNs - (int64_t)*lastNs) / 1000;
+    *lastNs += deltaUs * 1000;
+
+    out[length++] = record->type;
+    length += putVarint(out + length, ((uint64_t)deltaUs << 1) ^ (uint64_t)(deltaUs >> 63));
+    length += putVarint(out + length, record->value);
+    return length;
+}
+
+// Writes `value` as a varint: 7 bits a byte, low bits first, with the top bit set on all but the last.
+static size_t putVarint(unsigned char *out, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+
+    out[length++] = value;
+    return length;
+}
+
+// Reads a varint. Returns 0 on success, or -1 if it is cut short or too long.
+static int getVarint(FILE *file, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = getc(file);
+        if (byte == EOF)
+            return -1;
+
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return 0;
+    }
+
+    return -1;
+}
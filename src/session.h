@@ -0,0 +1,60 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// What a session log record holds. Values below 16, see session.c.
+typedef enum
+{
+    // A session began. The value is the pattern seed.
+    SESSION_START,
+    // The game took a joystick event off the queue. The value is `sessionPackEvent`'s.
+    SESSION_JOYSTICK,
+    // The pattern sequence finished showing.
+    SESSION_SEQUENCE_SHOWN,
+    // The countdown or success tune finished playing.
+    SESSION_TUNE_DONE,
+    // The fail screen timed out.
+    SESSION_GAME_OVER_DONE,
+    // The game entered a state. The value is the `GameState`.
+    SESSION_STATE,
+    // The player reached a level. The value is the level.
+    SESSION_LEVEL,
+} SessionRecordType;
+
+typedef struct
+{
+    SessionRecordType type;
+    uint64_t timeNs;
+    uint64_t value;
+} SessionRecord;
+
+// Reads a session log back, record by record.
+typedef struct
+{
+    FILE *file;
+    uint64_t timeNs;
+} SessionReader;
+
+int sessionRecordInit(const char *path, uint64_t seed);
+void sessionRecord(SessionRecordType type, uint64_t timeNs, uint64_t value);
+void sessionRecordStop();
+
+int sessionOpen(SessionReader *reader, const char *path);
+int sessionRead(SessionReader *reader, SessionRecord *record);
+void sessionClose(SessionReader *reader);
+
+// Packs a joystick event's type and direction into a record value, and back.
+static inline uint64_t sessionPackEvent(int type, int dir)
+{
+    return (uint64_t)type * 8 + (dir + 1);
+}
+
+static inline void sessionUnpackEvent(uint64_t value, int *type, int *dir)
+{
+    *type = value / 8;
+    *dir = (int)(value % 8) - 1;
+}
+
+#endif
@@ -0,0 +1,382 @@
+/*
+
+Several game stations driven from one process.
+
+A station is one cabinet's matrix (optionally a chain of panels) and joystick, each on pins of its
+own. Everything those drivers keep lives in its `Station`, so any number of them can run side by
+side; the game's own drivers use the same scan and sampling code with their fixed pins.
+
+The LED bar, buzzer and game loop have no per-station contexts, so the game itself still runs a
+single cabinet through its own drivers, and stations are only driven by the station benchmark.
+
+Stations do not get threads of their own. Each one has two jobs, scanning its matrix and sampling
+its joystick, and a pool of workers (one per core by default) runs every station's jobs in order of
+their deadlines. A render job latches one bit-plane of one row and is then due again at the next
+plane or row slot, so a row costs 1 to 4 short jobs. A sample job reads both ADC channels and the
+button, which takes far longer, so while one worker is sampling the others keep the scans on time.
+
+Workers take the job that is due first off a shared heap, wait for its deadline, run it, and put it
+back with its next deadline. Only one worker holds a given job at a time, so a station's scan and
+decoder state is never touched by two workers at once, and the heap's lock hands it over between them.
+
+A render job that finds its next row slot has already begun counts an overrun and restarts the scan
+from now, like the game's render thread. The stations one machine can hold at a refresh rate is the
+most that run without overruns (see the station benchmark in bench/).
+
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "clock.h"
+#include "station.h"
+#include "stats.h"
+#include "trace.h"
+
+// How often every station's joystick is sampled.
+#define SAMPLE_HZ 500
+
+// How many samples a station's calibration pass takes.
+#define CALIBRATION_SAMPLES 100
+
+// The most workers a pool can have.
+#define MAX_WORKERS 16
+
+// Waits shorter than this spin instead of sleeping, in nanoseconds.
+#define SPIN_THRESHOLD_NS 80000
+
+typedef enum
+{
+    JOB_RENDER,
+    JOB_SAMPLE,
+} JobKind;
+
+// A station's recurring job. Render jobs step through the planes of each row slot.
+typedef struct
+{
+    Station *station;
+    JobKind kind;
+    uint64_t deadline;
+    uint64_t rowStart;
+    int row;
+    int plane;
+} Job;
+
+static void *work(void *arg);
+static void render(Job *job);
+static void sample(Job *job);
+static void pushEvent(Station *station, const JoystickEvent *event);
+static void pushJob(Job *job);
+static Job *popJob();
+
+// Every station's jobs, and a min-heap of the ones no worker holds, ordered by deadline.
+//
+// Safety: The heap is guarded by `poolLock`. A job that is off the heap belongs to the worker that
+// took it, until that worker puts it back.
+static Job jobs[STATION_MAX * 2];
+static Job *heap[STATION_MAX * 2];
+static int heapCount = 0;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t workers[MAX_WORKERS];
+static int workerCount = 0;
+static atomic_int running = 0;
+
+// The length of a row slot at the pool's refresh rate.
+static uint64_t rowPeriod = 0;
+
+// Sets a station up on the pins in `config`, and calibrates its joystick, which must be at rest.
+// Returns 0 on success, or -1 if the station could not be set up.
+int stationInit(Station *station, const StationConfig *config)
+{
+    memset(station, 0, sizeof(Station));
+    station->config = *config;
+    if (station->config.panels < 1 || station->config.panels > LED_MATRIX_MAX_PANELS)
+        station->config.panels = 1;
+
+    station->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (station->eventFd == -1)
+    {
+        perror("Failed to create station eventfd");
+        return -1;
+    }
+
+    ledMatrixSetupPins(&config->matrix);
+    joystickSetupPins(&config->joystick);
+
+    unsigned char xSamples[CALIBRATION_SAMPLES];
+    unsigned char ySamples[CALIBRATION_SAMPLES];
+    int count = joystickCalibrationSamples(&config->joystick, xSamples, ySamples, CALIBRATION_SAMPLES);
+    if (count == 0)
+    {
+        printf("Station joystick on pin %d is not answering\n", config->joystick.cs);
+        close(station->eventFd);
+        return -1;
+    }
+
+    JoystickAxisCalibration xAxis;
+    JoystickAxisCalibration yAxis;
+    joystickCalibrate(&xAxis, xSamples, count);
+    joystickCalibrate(&yAxis, ySamples, count);
+    joystickDecoderInit(&station->decoder, &xAxis, &yAxis);
+
+    return 0;
+}
+
+// Publishes a frame for every panel of a station. Only one thread may publish to a station.
+void stationPublish(Station *station, const LedMatrixFramebuffer *framebuffer)
+{
+    ledMatrixSlotPublish(&station->slot, framebuffer->panels, station->config.panels, NULL);
+}
+
+// Takes the next event off a station's queue without waiting.
+// Returns 1 if an event was taken, or 0 if the queue is empty.
+int stationNextEvent(Station *station, JoystickEvent *event)
+{
+    unsigned int tail = atomic_load_explicit(&station->eventTail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&station->eventHead, memory_order_acquire))
+        return 0;
+
+    *event = station->events[tail % STATION_EVENT_QUEUE_SIZE];
+    atomic_store_explicit(&station->eventTail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Returns the eventfd signalled whenever an event is queued for a station.
+int stationEventFd(const Station *station)
+{
+    return station->eventFd;
+}
+
+// Fills `stats` with a station's statistics.
+void stationGetStats(Station *station, StationStats *stats)
+{
+    stats->frames = atomic_load_explicit(&station->frames, memory_order_relaxed);
+    stats->overruns = atomic_load_explicit(&station->overruns, memory_order_relaxed);
+    stats->samples = atomic_load_explicit(&station->samples, memory_order_relaxed);
+    stats->adcRejects = atomic_load_explicit(&station->adcRejects, memory_order_relaxed);
+    stats->eventsDropped = atomic_load_explicit(&station->eventsDropped, memory_order_relaxed);
+}
+
+// Starts driving `count` stations at `refreshHz`, on `workers` threads, or one per core if it is 0.
+// Returns 0 on success, or -1 if there are too many stations or the pool is already running.
+int stationPoolStart(Station *stations, int count, int workerLimit, unsigned int refreshHz)
+{
+    if (count < 1 || count > STATION_MAX || refreshHz == 0 || atomic_load(&running))
+        return -1;
+
+    if (workerLimit <= 0)
+        workerLimit = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workerLimit > MAX_WORKERS)
+        workerLimit = MAX_WORKERS;
+    if (workerLimit > count * 2)
+        workerLimit = count * 2;
+
+    rowPeriod = 1000000000ULL / refreshHz / SIZE;
+
+    uint64_t now = clockNowNs();
+    heapCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        jobs[i * 2] = (Job){.station = &stations[i], .kind = JOB_RENDER, .deadline = now, .rowStart = now};
+        jobs[i * 2 + 1] = (Job){.station = &stations[i], .kind = JOB_SAMPLE, .deadline = now};
+        pushJob(&jobs[i * 2]);
+        pushJob(&jobs[i * 2 + 1]);
+    }
+
+    atomic_store(&running, 1);
+    for (workerCount = 0; workerCount < workerLimit; workerCount++)
+    {
+        if (pthread_create(&workers[workerCount], NULL, work, NULL) != 0)
+            break;
+    }
+
+    printf("Stations: %d on %d workers at %u Hz\n", count, workerCount, refreshHz);
+    return workerCount > 0 ? 0 : -1;
+}
+
+// Stops the pool's workers once their current jobs are done, and waits for them.
+void stationPoolStop()
+{
+    atomic_store(&running, 0);
+    for (int i = 0; i < workerCount; i++)
+        pthread_join(workers[i], NULL);
+
+    workerCount = 0;
+}
+
+// Runs the job that is due first, over and over, until the pool is stopped.
+static void *work(void *arg)
+{
+    traceThread("station");
+
+    while (atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&poolLock);
+        Job *job = popJob();
+        pthread_mutex_unlock(&poolLock);
+
+        // Every job is held by another worker; one of them is due back within a row slot.
+        if (!job)
+        {
+            clockSleepUntilNs(clockNowNs() + rowPeriod);
+            continue;
+        }
+
+        clockWaitUntilNs(job->deadline, SPIN_THRESHOLD_NS);
+        if (job->kind == JOB_RENDER)
+            render(job);
+        else
+            sample(job);
+
+        pthread_mutex_lock(&poolLock);
+        pushJob(job);
+        pthread_mutex_unlock(&poolLock);
+    }
+
+    return NULL;
+}
+
+// Latches the job's plane of the station's current row, and moves the job on to the next plane
+// that changes anything, or to the next row slot.
+static void render(Job *job)
+{
+    Station *station = job->station;
+    int panels = station->config.panels;
+
+    traceBegin("station.render", job->row);
+
+    // Pick up a newly published frame only between scans, so every scan shows one frame.
+    if (job->row == 0 && job->plane == 0)
+    {
+        const LedMatrixAnimation *animation;
+        ledMatrixSlotRead(&station->slot, &station->framebuffer, panels, &animation, &station->sequence);
+        atomic_fetch_add_explicit(&station->frames, 1, memory_order_relaxed);
+        statsAdd(STATS_STATION_FRAMES, 1);
+    }
+
+    ledMatrixLatchPlane(&station->config.matrix, &station->framebuffer, panels, job->plane, job->row);
+    traceEnd("station.render", job->row);
+
+    for (int b = job->plane + 1; b < LED_MATRIX_BITS; b++)
+    {
+        if (ledMatrixPlaneChanged(&station->framebuffer, panels, b, job->row))
+        {
+            job->plane = b;
+            job->deadline = job->rowStart + ledMatrixPlaneOffsetNs(rowPeriod, b);
+            return;
+        }
+    }
+
+    job->plane = 0;
+    job->row = (job->row + 1) % SIZE;
+    job->rowStart += rowPeriod;
+
+    // If the next row slot should already have started, we overran. Restart the scan from now
+    // rather than rushing through the missed slots.
+    uint64_t now = clockNowNs();
+    if (now > job->rowStart)
+    {
+        atomic_fetch_add_explicit(&station->overruns, 1, memory_order_relaxed);
+        statsAdd(STATS_STATION_OVERRUNS, 1);
+        job->rowStart = now;
+    }
+
+    job->deadline = job->rowStart;
+}
+
+// Samples the station's joystick, decodes the sample into events, and schedules the next sample.
+static void sample(Job *job)
+{
+    Station *station = job->station;
+    job->deadline += 1000000000ULL / SAMPLE_HZ;
+
+    traceBegin("station.sample", 0);
+
+    // A corrupt transfer throws the whole sample away, the next one is only a period away.
+    JoystickSample joystickSample;
+    if (joystickReadSample(&station->config.joystick, &joystickSample) == 0)
+    {
+        atomic_fetch_add_explicit(&station->samples, 1, memory_order_relaxed);
+        statsAdd(STATS_STATION_SAMPLES, 1);
+
+        JoystickEvent events[JOYSTICK_DECODER_MAX_EVENTS];
+        int count = joystickDecoderFeed(&station->decoder, &joystickSample, events);
+        for (int i = 0; i < count; i++)
+            pushEvent(station, &events[i]);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(&station->adcRejects, 1, memory_order_relaxed);
+        statsAdd(STATS_STATION_REJECTS, 1);
+    }
+
+    traceEnd("station.sample", 0);
+
+    // Skip the slots we missed instead of sampling in a burst to catch up.
+    uint64_t now = clockNowNs();
+    if (now > job->deadline)
+        job->deadline = now;
+}
+
+// Queues an event for the station's game, dropping it if the queue is full.
+static void pushEvent(Station *station, const JoystickEvent *event)
+{
+    unsigned int head = atomic_load_explicit(&station->eventHead, memory_order_relaxed);
+    if (head - atomic_load_explicit(&station->eventTail, memory_order_acquire) == STATION_EVENT_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&station->eventsDropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    station->events[head % STATION_EVENT_QUEUE_SIZE] = *event;
+    atomic_store_explicit(&station->eventHead, head + 1, memory_order_release);
+
+    uint64_t one = 1;
+    if (write(station->eventFd, &one, sizeof(one)) == -1)
+        return;
+}
+
+// Puts a job on the heap. The caller must hold `poolLock`.
+static void pushJob(Job *job)
+{
+    int i = heapCount++;
+    while (i > 0 && heap[(i - 1) / 2]->deadline > job->deadline)
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    heap[i] = job;
+}
+
+// Takes the job that is due first off the heap, or returns NULL if it is empty.
+// The caller must hold `poolLock`.
+static Job *popJob()
+{
+    if (heapCount == 0)
+        return NULL;
+
+    Job *first = heap[0];
+    Job *last = heap[--heapCount];
+    int i = 0;
+
+    while (i * 2 + 1 < heapCount)
+    {
+        int child = i * 2 + 1;
+        if (child + 1 < heapCount && heap[child + 1]->deadline < heap[child]->deadline)
+            child++;
+        if (heap[child]->deadline >= last->deadline)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = last;
+    return first;
+}
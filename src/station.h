@@ -0,0 +1,68 @@
+#ifndef STATION_H
+#define STATION_H
+
+#include <stdatomic.h>
+
+#include "joystick.h"
+#include "joystick_decoder.h"
+#include "led_matrix.h"
+
+// The most stations one process can drive.
+#define STATION_MAX 64
+
+// Size of each station's event queue. Must be a power of two.
+#define STATION_EVENT_QUEUE_SIZE 64
+
+// How a station is wired: its matrix, how many panels are chained on it, and its joystick.
+typedef struct
+{
+    LedMatrixPins matrix;
+    int panels;
+    JoystickPins joystick;
+} StationConfig;
+
+// One game station's drivers: the frame it shows, and its joystick's decoder and event queue.
+typedef struct
+{
+    StationConfig config;
+
+    // Frames published for the station, picked up between scans.
+    LedMatrixSlot slot;
+
+    // Decoded events, from the worker sampling the station (producer) to its game (consumer).
+    JoystickEvent events[STATION_EVENT_QUEUE_SIZE];
+    atomic_uint eventHead;
+    atomic_uint eventTail;
+    int eventFd;
+
+    // Statistics.
+    atomic_ulong frames;
+    atomic_ulong overruns;
+    atomic_ulong samples;
+    atomic_ulong adcRejects;
+    atomic_ulong eventsDropped;
+
+    // Only touched by the worker that holds the station's job, see station.c.
+    LedMatrixFramebuffer framebuffer;
+    unsigned long sequence;
+    JoystickDecoder decoder;
+} Station;
+
+typedef struct
+{
+    unsigned long frames;
+    unsigned long overruns;
+    unsigned long samples;
+    unsigned long adcRejects;
+    unsigned long eventsDropped;
+} StationStats;
+
+int stationInit(Station *station, const StationConfig *config);
+void stationPublish(Station *station, const LedMatrixFramebuffer *framebuffer);
+int stationNextEvent(Station *station, JoystickEvent *event);
+int stationEventFd(const Station *station);
+void stationGetStats(Station *station, StationStats *stats);
+int stationPoolStart(Station *stations, int count, int workers, unsigned int refreshHz);
+void stationPoolStop();
+
+#endif
@@ -0,0 +1,151 @@
+/*
+
+A registry of performance counters and histograms shared by the drivers and the game loop.
+
+Counters and histograms are plain atomics updated with relaxed operations, so recording one costs a
+few instructions and never blocks, even from the render thread. Histograms bucket values by powers
+of two, so they stay small and need no locking, while still showing the shape of a distribution.
+
+A snapshot is written to the stats file whenever the process receives SIGUSR1, and optionally at a
+fixed interval. Snapshots are written by a thread of their own, so no thread doing real work ever
+waits on the file system. The file is replaced atomically, so a reader never sees half of one.
+
+*/
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "clock.h"
+#include "stats.h"
+
+static void *dumpLoop(void *arg);
+static void requestDump(int signal);
+
+#define STATS_KEY(name, key) key,
+
+static const char *const COUNTER_KEYS[] = {STATS_COUNTERS(STATS_KEY)};
+static const char *const HISTOGRAM_KEYS[] = {STATS_HISTOGRAMS(STATS_KEY)};
+
+#undef STATS_KEY
+
+atomic_ulong statsCounters[STATS_COUNTER_COUNT];
+StatsHistogramData statsHistograms[STATS_HISTOGRAM_COUNT];
+
+// Where snapshots are written, and how often without being asked (0 for only on SIGUSR1).
+static char statsPath[256];
+static unsigned int statsIntervalMs = 0;
+
+// Signalled by the SIGUSR1 handler to wake the dump thread.
+static int dumpFd = -1;
+
+// Starts writing snapshots to `path` on SIGUSR1, and every `intervalMs` if it is not 0.
+// Returns 0 on success, or -1 if the dump thread could not be set up.
+int statsInit(const char *path, unsigned int intervalMs)
+{
+    snprintf(statsPath, sizeof(statsPath), "%s", path);
+    statsIntervalMs = intervalMs;
+
+    dumpFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dumpFd == -1)
+    {
+        perror("Failed to create stats eventfd");
+        return -1;
+    }
+
+    // Start the stats dump thread, and only then route SIGUSR1 to it.
+    pthread_t dump_thread;
+    if (pthread_create(&dump_thread, NULL, dumpLoop, NULL) != 0)
+    {
+        printf("Failed to start the stats dump thread\n");
+        close(dumpFd);
+        dumpFd = -1;
+        return -1;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = requestDump;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+
+    return 0;
+}
+
+// Writes a snapshot of every counter and histogram to `path`.
+// Returns 0 on success, or -1 if the file could not be written.
+int statsDump(const char *path)
+{
+    char tmpPath[sizeof(statsPath) + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    FILE *file = fopen(tmpPath, "w");
+    if (!file)
+    {
+        perror("Failed to open stats file");
+        return -1;
+    }
+
+    fprintf(file, "time_ms %llu\n", (unsigned long long)(clockNowNs() / 1000000));
+
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+        fprintf(file, "%s %lu\n", COUNTER_KEYS[i], atomic_load_explicit(&statsCounters[i], memory_order_relaxed));
+
+    // Histograms list the upper bound and count of every bucket that is not empty.
+    for (int i = 0; i < STATS_HISTOGRAM_COUNT; i++)
+    {
+        StatsHistogramData *data = &statsHistograms[i];
+        unsigned long count = atomic_load_explicit(&data->count, memory_order_relaxed);
+        unsigned long sum = atomic_load_explicit(&data->sum, memory_order_relaxed);
+
+        fprintf(file, "%s count=%lu avg=%lu max=%lu", HISTOGRAM_KEYS[i], count, count ? sum / count : 0,
+                atomic_load_explicit(&data->max, memory_order_relaxed));
+
+        for (int b = 0; b < STATS_BUCKETS; b++)
+        {
+            unsigned long bucket = atomic_load_explicit(&data->buckets[b], memory_order_relaxed);
+            if (bucket)
+                fprintf(file, " <%llu:%lu", b ? 1ULL << b : 1ULL, bucket);
+        }
+
+        fprintf(file, "\n");
+    }
+
+    if (fclose(file) != 0 || rename(tmpPath, path) == -1)
+    {
+        perror("Failed to write stats file");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Writes a snapshot whenever one is requested, or the interval passes.
+static void *dumpLoop(void *arg)
+{
+    struct pollfd fd = {.fd = dumpFd, .events = POLLIN};
+    int64_t intervalNs = statsIntervalMs ? statsIntervalMs * 1000000LL : -1;
+
+    while (1)
+    {
+        uint64_t count;
+        if (clockPoll(&fd, 1, intervalNs) > 0 && read(dumpFd, &count, sizeof(count)) == -1)
+            continue;
+
+        statsDump(statsPath);
+    }
+
+    return NULL;
+}
+
+// Handles SIGUSR1. Only wakes the dump thread, since writing the file is not async-signal-safe.
+static void requestDump(int signal)
+{
+    uint64_t one = 1;
+    if (write(dumpFd, &one, sizeof(one)) == -1)
+        return;
+}
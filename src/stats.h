@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+
+// Every counter, as (name, key in the stats file).
+#define STATS_COUNTERS(X)                        \
+    X(MATRIX_FRAMES, "matrix.frames")            \
+    X(MATRIX_OVERRUNS, "matrix.overruns")        \
+    X(MATRIX_PUBLISHED, "matrix.published")      \
+    X(MATRIX_SLOT_BUSY, "matrix.slot_busy")      \
+    X(JOYSTICK_SAMPLES, "joystick.samples")      \
+    X(JOYSTICK_REJECTS, "joystick.adc_rejects")  \
+    X(JOYSTICK_EVENTS, "joystick.events")        \
+    X(JOYSTICK_DROPPED, "joystick.dropped")      \
+    X(BAR_COMMITS, "bar.commits")                \
+    X(BAR_FRAMES, "bar.frames")                  \
+    X(BUZZER_NOTES, "buzzer.notes")              \
+    X(STATION_FRAMES, "station.frames")          \
+    X(STATION_OVERRUNS, "station.overruns")      \
+    X(STATION_SAMPLES, "station.samples")        \
+    X(STATION_REJECTS, "station.adc_rejects")    \
+    X(GAMES, "game.games")                       \
+    X(LEVELS, "game.levels")
+
+// Every histogram, as (name, key in the stats file).
+#define STATS_HISTOGRAMS(X)                          \
+    X(MATRIX_FRAME_US, "matrix.frame_us")            \
+    X(JOYSTICK_LATENCY_US, "joystick.latency_us")    \
+    X(BAR_FRAME_US, "bar.frame_us")                  \
+    X(BAR_COMMIT_BYTES, "bar.commit_bytes")          \
+    X(LEVEL_REACHED, "game.level_reached")
+
+#define STATS_ENUM(name, key) STATS_##name,
+
+typedef enum
+{
+    STATS_COUNTERS(STATS_ENUM)
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+typedef enum
+{
+    STATS_HISTOGRAMS(STATS_ENUM)
+    STATS_HISTOGRAM_COUNT
+} StatsHistogram;
+
+#undef STATS_ENUM
+
+// Histogram buckets are powers of two: bucket `b` counts values from 2^(b-1) up to 2^b - 1,
+// and bucket 0 counts zeroes.
+#define STATS_BUCKETS 33
+
+typedef struct
+{
+    atomic_ulong count;
+    atomic_ulong sum;
+    atomic_ulong max;
+    atomic_ulong buckets[STATS_BUCKETS];
+} StatsHistogramData;
+
+extern atomic_ulong statsCounters[STATS_COUNTER_COUNT];
+extern StatsHistogramData statsHistograms[STATS_HISTOGRAM_COUNT];
+
+int statsInit(const char *path, unsigned int intervalMs);
+int statsDump(const char *path);
+
+// Adds `amount` to a counter.
+static inline void statsAdd(StatsCounter counter, unsigned long amount)
+{
+    atomic_fetch_add_explicit(&statsCounters[counter], amount, memory_order_relaxed);
+}
+
+// Adds a value to a histogram.
+static inline void statsRecord(StatsHistogram histogram, unsigned long value)
+{
+    StatsHistogramData *data = &statsHistograms[histogram];
+    int bucket = value ? (int)(sizeof(value) * 8) - __builtin_clzl(value) : 0;
+    if (bucket >= STATS_BUCKETS)
+        bucket = STATS_BUCKETS - 1;
+
+    atomic_fetch_add_explicit(&data->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&data->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&data->buckets[bucket], 1, memory_order_relaxed);
+
+    unsigned long max = atomic_load_explicit(&data->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&data->max, &max, value, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+#endif
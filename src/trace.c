@@ -0,0 +1,207 @@
+/*
+
+A timeline of what every thread is doing, for finding where latency comes from.
+
+Each thread records spans (a begin and an end) and instant events into a ring of its own, so
+recording never takes a lock or contends with another thread: it is a clock read and a few stores,
+and the ring's head is published with a release store. When tracing is off, every trace call is a
+single relaxed load and a branch.
+
+Rings keep the most recent TRACE_RING_SIZE events of their thread. They are written out in Chrome's
+trace event format when the program exits, and can be opened in chrome://tracing or Perfetto. Time
+stamps come from the program's clock (see clock.c), so a simulated session shows simulated time.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clock.h"
+#include "trace.h"
+
+// How many events each thread keeps. Must be a power of two.
+#define TRACE_RING_SIZE 32768
+
+// How many threads can record events.
+#define TRACE_MAX_THREADS 16
+
+#define TRACE_NAME_SIZE 16
+
+typedef struct
+{
+    uint64_t timeNs;
+    const char *name;
+    long arg;
+    char phase;
+} TraceEvent;
+
+typedef struct
+{
+    char name[TRACE_NAME_SIZE];
+    atomic_ulong head;
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static void dumpAtExit();
+static TraceRing *createRing();
+
+atomic_int traceEnabled = 0;
+
+// Where the trace is written when the program exits.
+static char tracePath[256];
+
+// Every thread's ring, in the order the threads first recorded an event.
+//
+// Safety: A ring is only ever written by its own thread. Readers load `head` with acquire ordering,
+// and throw away whatever the writer may have overwritten while they were copying.
+static _Atomic(TraceRing *) rings[TRACE_MAX_THREADS];
+static atomic_int ringCount = 0;
+
+// The calling thread's ring, whether it has asked for one yet, and the name it is shown under.
+static __thread TraceRing *threadRing = NULL;
+static __thread int threadRingTried = 0;
+static __thread char threadName[TRACE_NAME_SIZE];
+
+// Starts recording events, and writes them to `path` when the program exits.
+// Returns 0 on success, or -1 if the trace could not be set up.
+int traceInit(const char *path)
+{
+    snprintf(tracePath, sizeof(tracePath), "%s", path);
+
+    if (atexit(dumpAtExit) != 0)
+    {
+        printf("Failed to register the trace writer\n");
+        return -1;
+    }
+
+    atomic_store_explicit(&traceEnabled, 1, memory_order_relaxed);
+    return 0;
+}
+
+// Names the calling thread in the trace. Call it before the thread records anything.
+void traceThread(const char *name)
+{
+    snprintf(threadName, sizeof(threadName), "%s", name);
+}
+
+// Appends an event to the calling thread's ring, overwriting the oldest one if it is full.
+void traceRecord(char phase, const char *name, long arg)
+{
+    TraceRing *ring = threadRing;
+    if (!ring)
+    {
+        if (threadRingTried)
+            return;
+
+        ring = createRing();
+        if (!ring)
+            return;
+    }
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent *event = &ring->events[head % TRACE_RING_SIZE];
+    event->timeNs = clockNowNs();
+    event->name = name;
+    event->arg = arg;
+    event->phase = phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Writes every thread's events to `path` in Chrome's trace event format.
+// Returns 0 on success, or -1 if the file could not be written.
+int traceDump(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        perror("Failed to open trace file");
+        return -1;
+    }
+
+    TraceEvent *events = malloc(sizeof(TraceEvent) * TRACE_RING_SIZE);
+    if (!events)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"memory-game\"}}");
+
+    int count = atomic_load_explicit(&ringCount, memory_order_acquire);
+    if (count > TRACE_MAX_THREADS)
+        count = TRACE_MAX_THREADS;
+    for (int tid = 0; tid < count; tid++)
+    {
+        TraceRing *ring = atomic_load_explicit(&rings[tid], memory_order_acquire);
+        if (!ring)
+            continue;
+
+        fprintf(file, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                tid + 1, ring->name);
+
+        // Copy the ring, then skip whatever the thread may have overwritten in the meantime.
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (unsigned long i = first; i < head; i++)
+            events[i % TRACE_RING_SIZE] = ring->events[i % TRACE_RING_SIZE];
+
+        atomic_thread_fence(memory_order_acquire);
+        unsigned long newHead = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        if (newHead >= TRACE_RING_SIZE && newHead - TRACE_RING_SIZE + 1 > first)
+            first = newHead - TRACE_RING_SIZE + 1;
+
+        for (unsigned long i = first; i < head; i++)
+        {
+            const TraceEvent *event = &events[i % TRACE_RING_SIZE];
+            fprintf(file, ",\n  {\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %llu.%03u, \"pid\": 1, \"tid\": %d",
+                    event->name, event->phase, (unsigned long long)(event->timeNs / 1000),
+                    (unsigned int)(event->timeNs % 1000), tid + 1);
+
+            if (event->phase == TRACE_INSTANT)
+                fprintf(file, ", \"s\": \"t\"");
+
+            fprintf(file, ", \"args\": {\"value\": %ld}}", event->arg);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    free(events);
+
+    if (fclose(file) != 0)
+    {
+        perror("Failed to write trace file");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void dumpAtExit()
+{
+    atomic_store_explicit(&traceEnabled, 0, memory_order_relaxed);
+    if (traceDump(tracePath) == 0)
+        printf("Trace written to %s\n", tracePath);
+}
+
+// Gives the calling thread a ring. Returns NULL if every ring is taken.
+static TraceRing *createRing()
+{
+    // Each thread asks at most once, so the count grows by at most one per thread.
+    threadRingTried = 1;
+
+    int index = atomic_fetch_add_explicit(&ringCount, 1, memory_order_relaxed);
+    if (index >= TRACE_MAX_THREADS)
+        return NULL;
+
+    TraceRing *ring = calloc(1, sizeof(TraceRing));
+    if (!ring)
+        return NULL;
+
+    snprintf(ring->name, sizeof(ring->name), "%s", threadName[0] ? threadName : "thread");
+    atomic_store_explicit(&rings[index], ring, memory_order_release);
+    threadRing = ring;
+
+    return ring;
+}
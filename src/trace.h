@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+
+// Event phases, as Chrome's trace format names them.
+#define TRACE_BEGIN 'B'
+#define TRACE_END 'E'
+#define TRACE_INSTANT 'i'
+
+extern atomic_int traceEnabled;
+
+int traceInit(const char *path);
+int traceDump(const char *path);
+void traceThread(const char *name);
+void traceRecord(char phase, const char *name, long arg);
+
+// Starts a span on the calling thread. `name` must be a string literal.
+static inline void traceBegin(const char *name, long arg)
+{
+    if (atomic_load_explicit(&traceEnabled, memory_order_relaxed))
+        traceRecord(TRACE_BEGIN, name, arg);
+}
+
+// Ends the span last started on the calling thread.
+static inline void traceEnd(const char *name, long arg)
+{
+    if (atomic_load_explicit(&traceEnabled, memory_order_relaxed))
+        traceRecord(TRACE_END, name, arg);
+}
+
+// Records a point in time on the calling thread. `name` must be a string literal.
+static inline void traceInstant(const char *name, long arg)
+{
+    if (atomic_load_explicit(&traceEnabled, memory_order_relaxed))
+        traceRecord(TRACE_INSTANT, name, arg);
+}
+
+#endif
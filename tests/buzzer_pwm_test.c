@@ -0,0 +1,63 @@
+/*
+
+Unit tests of the hardware PWM buzzer's tone math (buzzer_pwm.c), run on a simulated register block.
+
+    gcc -O2 -Isrc tests/buzzer_pwm_test.c src/buzzer_pwm.c -o buzzer-pwm-test -lm
+    ./buzzer-pwm-test
+
+Every tone from MIN_TONE to MAX_TONE Hz, which covers all of the game's tunes and pattern tones
+(120 to 784 Hz), is set on the registers. The frequency they produce must be within 1 Hz of the
+tone, and the duty cycle within 1 permille of 500: a period of an odd number of counts cannot be
+split exactly in half.
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "buzzer_pwm.h"
+
+#define MIN_TONE 20
+#define MAX_TONE 1000
+
+int main()
+{
+    int failures = 0;
+    BuzPwmRegisters regs;
+    buzPwmInit(&regs);
+
+    if (buzPwmFrequency(&regs) != 0)
+    {
+        printf("FAIL: a reset channel plays %u Hz\n", buzPwmFrequency(&regs));
+        failures++;
+    }
+
+    for (int tone = MIN_TONE; tone <= MAX_TONE; tone++)
+    {
+        buzPwmSetTone(&regs, tone);
+
+        // The frequency straight from the registers, and as the helper reports it.
+        double exact = (double)(BUZ_PWM_BASE_CLOCK / regs.divisor) / regs.range;
+        unsigned int reported = buzPwmFrequency(&regs);
+        unsigned int duty = buzPwmDutyPermille(&regs);
+
+        if (fabs(exact - tone) > 1 || abs((int)reported - tone) > 1 || abs((int)duty - 500) > 1)
+        {
+            printf("FAIL: %d Hz: range %u data %u plays %.2f Hz (reported %u Hz) at %u permille\n", tone, regs.range,
+                   regs.data, exact, reported, duty);
+            failures++;
+        }
+
+        // Silence keeps the period, and holds the output low.
+        buzPwmSetTone(&regs, 0);
+        if (regs.data != 0 || buzPwmFrequency(&regs) != 0 || buzPwmDutyPermille(&regs) != 0)
+        {
+            printf("FAIL: silence after %d Hz leaves data %u\n", tone, regs.data);
+            failures++;
+        }
+    }
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/*
+
+Unit tests of the joystick decoder (joystick_decoder.c), fed synthetic ADC traces.
+
+    gcc -O2 -Isrc tests/joystick_decoder_test.c src/joystick_decoder.c -o joystick-decoder-test
+    ./joystick-decoder-test
+
+Each trace starts from a freshly calibrated decoder, with the stick resting at 128 with a little
+noise, and checks the exact events it decodes into.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "joystick_decoder.h"
+
+// The most events a trace is expected to decode into.
+#define MAX_TRACE_EVENTS 16
+
+#define REST 128
+#define NOISE 2
+
+// How noisy the slow drift is.
+#define DRIFT_NOISE 12
+
+// The events a trace decoded into.
+typedef struct
+{
+    JoystickEvent events[MAX_TRACE_EVENTS];
+    int count;
+} Trace;
+
+static JoystickDecoder decoder;
+static uint64_t timeNs;
+static uint32_t noiseState = 1;
+static int failures = 0;
+
+static void reset();
+static void feed(int x, int y, int button, int times, Trace *trace);
+static int noise();
+static void expect(const char *name, const Trace *trace, int count, const JoystickEvent *expected);
+
+int main()
+{
+    Trace trace;
+
+    // Noise at rest never leaves the center.
+    reset();
+    trace.count = 0;
+    for (int i = 0; i < 1000; i++)
+        feed(REST + noise(), REST + noise(), 0, 1, &trace);
+    expect("noise at rest", &trace, 0, NULL);
+
+    // A single full-scale spike is thrown away by the median, on either axis.
+    reset();
+    trace.count = 0;
+    feed(REST, REST, 0, 10, &trace);
+    feed(255, REST, 0, 1, &trace);
+    feed(REST, REST, 0, 10, &trace);
+    feed(REST, 0, 0, 1, &trace);
+    feed(REST, REST, 0, 10, &trace);
+    expect("single spike", &trace, 0, NULL);
+
+    // Nor does a single spike to the other end while a direction is held.
+    reset();
+    trace.count = 0;
+    feed(255, REST, 0, 10, &trace);
+    feed(0, REST, 0, 1, &trace);
+    feed(255, REST, 0, 10, &trace);
+    expect("spike while held", &trace, 1, (JoystickEvent[]){{JOY_EVENT_DIR, JOY_RIGHT, 0}});
+
+    // A slow drift all the way across is one direction, and one center on the way back, even with
+    // a lot of noise on top: the hysteresis keeps it from chattering at the thresholds.
+    reset();
+    trace.count = 0;
+    for (int x = REST; x <= 255 - DRIFT_NOISE; x++)
+        feed(x + noise() * DRIFT_NOISE / NOISE, REST + noise(), 0, 4, &trace);
+    for (int x = 255 - DRIFT_NOISE; x >= REST; x--)
+        feed(x + noise() * DRIFT_NOISE / NOISE, REST + noise(), 0, 4, &trace);
+    expect("slow drift", &trace, 2, (JoystickEvent[]){{JOY_EVENT_DIR, JOY_RIGHT, 0}, {JOY_EVENT_CENTER, -1, 0}});
+
+    // A drift of the rest point that stays well inside the thresholds is nothing.
+    reset();
+    trace.count = 0;
+    for (int x = REST; x <= REST + 30; x++)
+        feed(x + noise(), REST - (x - REST) + noise(), 0, 10, &trace);
+    expect("rest drift", &trace, 0, NULL);
+
+    // A fast flick, a handful of samples at the end stop, is recognised, and so is its return.
+    reset();
+    trace.count = 0;
+    feed(REST, REST, 0, 5, &trace);
+    feed(REST, 0, 0, 4, &trace);
+    feed(REST, REST, 0, 10, &trace);
+    feed(0, REST, 0, 4, &trace);
+    feed(REST, REST, 0, 10, &trace);
+    expect("fast flick", &trace, 4,
+           (JoystickEvent[]){{JOY_EVENT_DIR, JOY_DOWN, 0}, {JOY_EVENT_CENTER, -1, 0}, {JOY_EVENT_DIR, JOY_LEFT, 0}, {JOY_EVENT_CENTER, -1, 0}});
+    if (decoder.missedFlicks != 0)
+    {
+        printf("FAIL: fast flick: %lu missed flicks\n", decoder.missedFlicks);
+        failures++;
+    }
+
+    // The button must read the same twice to change, so a one-sample glitch is ignored.
+    reset();
+    trace.count = 0;
+    feed(REST, REST, 1, 1, &trace);
+    feed(REST, REST, 0, 5, &trace);
+    feed(REST, REST, 1, 5, &trace);
+    feed(REST, REST, 0, 5, &trace);
+    expect("button", &trace, 2, (JoystickEvent[]){{JOY_EVENT_BUTTON_DOWN, -1, 0}, {JOY_EVENT_BUTTON_UP, -1, 0}});
+
+    // The median's history keeps working past any number of samples.
+    reset();
+    trace.count = 0;
+    for (int i = 0; i < 100000; i++)
+        feed(REST + noise(), REST + noise(), 0, 1, &trace);
+    feed(255, REST, 0, 1, &trace);
+    feed(REST, REST, 0, 5, &trace);
+    expect("long run", &trace, 0, NULL);
+
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
+
+// Starts a trace from a decoder calibrated on noisy samples at rest.
+static void reset()
+{
+    unsigned char x[100];
+    unsigned char y[100];
+    for (int i = 0; i < 100; i++)
+    {
+        x[i] = REST + noise();
+        y[i] = REST + noise();
+    }
+
+    JoystickAxisCalibration xAxis;
+    JoystickAxisCalibration yAxis;
+    joystickCalibrate(&xAxis, x, 100);
+    joystickCalibrate(&yAxis, y, 100);
+    joystickDecoderInit(&decoder, &xAxis, &yAxis);
+    timeNs = 0;
+}
+
+// Feeds the same sample `times` times, 2ms apart like the sampler's, adding the events to `trace`.
+static void feed(int x, int y, int button, int times, Trace *trace)
+{
+    for (int i = 0; i < times; i++)
+    {
+        JoystickSample sample = {.timeNs = timeNs, .x = x, .y = y, .button = button};
+        JoystickEvent events[JOYSTICK_DECODER_MAX_EVENTS];
+        int count = joystickDecoderFeed(&decoder, &sample, events);
+
+        for (int e = 0; e < count; e++)
+        {
+            if (trace->count < MAX_TRACE_EVENTS)
+                trace->events[trace->count] = events[e];
+            trace->count++;
+        }
+
+        timeNs += 2000000;
+    }
+}
+
+// Returns a deterministic offset within the noise floor.
+static int noise()
+{
+    noiseState = noiseState * 1103515245 + 12345;
+    return (int)((noiseState >> 16) % (2 * NOISE + 1)) - NOISE;
+}
+
+// Checks that a trace decoded into exactly the expected events' types and directions.
+static void expect(const char *name, const Trace *trace, int count, const JoystickEvent *expected)
+{
+    int ok = trace->count == count;
+    for (int i = 0; ok && i < count; i++)
+        ok = trace->events[i].type == expected[i].type && trace->events[i].dir == expected[i].dir;
+
+    if (ok)
+        return;
+
+    printf("FAIL: %s: expected %d events, got %d:", name, count, trace->count);
+    for (int i = 0; i < trace->count && i < MAX_TRACE_EVENTS; i++)
+        printf(" (type %d, dir %d)", trace->events[i].type, trace->events[i].dir);
+    printf("\n");
+    failures++;
+}
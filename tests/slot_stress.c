@@ -0,0 +1,116 @@
+/*
+
+Stress test of the matrix frame slot (see ledMatrixSlotPublish in led_matrix.c).
+
+One thread publishes frames into a slot as fast as it can, while another reads them back in a tight
+loop. Every byte of a published frame, on every panel, and its animation pointer encode the same
+counter, so a copy that mixes two frames shows up as bytes that disagree. The test fails on the
+first mixed frame, or if a frame older than one already read comes back.
+
+    gcc -O2 -Isim -Isrc tests/slot_stress.c bench/gpio_counter.c src/led_matrix.c src/animation.c \
+        src/clock.c src/gpio.c src/frame_export.c src/stats.c src/trace.c \
+        -o slot-stress -lpthread -lm -lrt
+    ./slot-stress [seconds]
+
+It needs at least two cores to interleave the threads finely; on one it still runs, but the reader
+mostly sees whole frames.
+
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+#include "led_matrix.h"
+
+#define DEFAULT_SECONDS 2
+
+static LedMatrixSlot slot;
+static atomic_int stop = 0;
+static unsigned long published = 0;
+
+static void *publish(void *arg);
+static int checkFrame(const LedMatrixFramebuffer *framebuffer, const LedMatrixAnimation *animation, unsigned long *value);
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+    if (seconds < 1)
+        seconds = DEFAULT_SECONDS;
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, publish, NULL) != 0)
+    {
+        printf("Failed to start the publisher\n");
+        return 1;
+    }
+
+    uint64_t end = clockNowNs() + seconds * 1000000000ULL;
+    unsigned long sequence = 0;
+    unsigned long reads = 0;
+    unsigned long last = 0;
+    int failed = 0;
+
+    while (!failed && clockNowNs() < end)
+    {
+        LedMatrixFramebuffer framebuffer;
+        const LedMatrixAnimation *animation;
+        if (!ledMatrixSlotRead(&slot, &framebuffer, LED_MATRIX_MAX_PANELS, &animation, &sequence))
+            continue;
+
+        reads++;
+        unsigned long value;
+        if (!checkFrame(&framebuffer, animation, &value))
+        {
+            printf("FAIL: torn frame at sequence %lu\n", sequence);
+            failed = 1;
+        }
+        else if (value < last)
+        {
+            printf("FAIL: frame %lu read after frame %lu\n", value, last);
+            failed = 1;
+        }
+        last = value;
+    }
+
+    atomic_store(&stop, 1);
+    pthread_join(writer, NULL);
+
+    printf("%lu frames published, %lu read, %s\n", published, reads, failed ? "torn frames seen" : "no torn frames");
+    return failed;
+}
+
+// Publishes frames whose every byte, and animation pointer, hold the frame's counter.
+static void *publish(void *arg)
+{
+    LedMatrixFrame panels[LED_MATRIX_MAX_PANELS];
+
+    for (unsigned long value = 1; !atomic_load_explicit(&stop, memory_order_relaxed); value++)
+    {
+        memset(panels, value & 0xff, sizeof(panels));
+        ledMatrixSlotPublish(&slot, panels, LED_MATRIX_MAX_PANELS, (const LedMatrixAnimation *)(uintptr_t)value);
+        published = value;
+    }
+
+    return NULL;
+}
+
+// Returns 1 if every byte of the frame agrees with its animation pointer, storing the counter in
+// `value`, or 0 if the frame mixes two publishes.
+static int checkFrame(const LedMatrixFramebuffer *framebuffer, const LedMatrixAnimation *animation, unsigned long *value)
+{
+    *value = (uintptr_t)animation;
+    const unsigned char *bytes = (const unsigned char *)framebuffer->panels;
+
+    for (size_t i = 0; i < sizeof(framebuffer->panels); i++)
+    {
+        if (bytes[i] != (*value & 0xff))
+            return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,370 @@
+/*
+
+Builds an asset pack (see src/asset_format.h) from a text description of frames and animations.
+
+    gcc -O2 -Isrc tools/asset_pack.c -o asset-pack
+    ./asset-pack assets/default.txt assets.pack
+
+The description holds frames and animations, in any order. Blank lines and lines starting with `#`
+are ignored.
+
+    frame <name>
+    <8 rows of 8 pixels, `#` for on and `.` for off>
+
+    animation <name> [loop]
+    <frame> <cut|slide_left|slide_right|slide_up|slide_down|wipe|fade> <transition ms> <hold ms>
+    ...
+    end
+
+Names are at most ASSET_NAME_SIZE (16) bytes, and longer ones are refused rather than cut short, so
+two names sharing their first 16 bytes can never end up as the same entry.
+
+The pack is written next to the output and renamed over it, so a running game never maps a pack
+that is half written, and reloads it as soon as it is in place.
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asset_format.h"
+
+#define MAX_LINE 256
+
+static const char *const TRANSITIONS[] = {"cut", "slide_left", "slide_right", "slide_up", "slide_down", "wipe", "fade"};
+#define TRANSITION_COUNT (int)(sizeof(TRANSITIONS) / sizeof(TRANSITIONS[0]))
+
+typedef struct
+{
+    char name[ASSET_NAME_SIZE];
+    unsigned char rows[8];
+} Frame;
+
+typedef struct
+{
+    char frame[ASSET_NAME_SIZE];
+    int transition;
+    int transitionMs;
+    int holdMs;
+} Keyframe;
+
+typedef struct
+{
+    char name[ASSET_NAME_SIZE];
+    int loop;
+    int firstKeyframe;
+    int keyframeCount;
+} Animation;
+
+static Frame *frames = NULL;
+static int frameCount = 0;
+static Animation *animations = NULL;
+static int animationCount = 0;
+static Keyframe *keyframes = NULL;
+static int keyframeCount = 0;
+
+static int parse(FILE *file, const char *path);
+static int writePack(const char *path);
+static int setName(char *name, const char *text, int line);
+static void *grow(void *items, int count, size_t size);
+static int compareFrames(const void *a, const void *b);
+static int compareAnimations(const void *a, const void *b);
+static int findFrame(const char *name);
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <description.txt> <output.pack>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *file = fopen(argv[1], "r");
+    if (!file)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    int result = parse(file, argv[1]);
+    fclose(file);
+    if (result == -1)
+        return 1;
+
+    // Names are sorted so the game can binary search them. Keyframes refer to frames by name until
+    // the pack is written, so sorting cannot break them.
+    qsort(frames, frameCount, sizeof(Frame), compareFrames);
+    qsort(animations, animationCount, sizeof(Animation), compareAnimations);
+
+    for (int i = 1; i < frameCount; i++)
+    {
+        if (strncmp(frames[i - 1].name, frames[i].name, ASSET_NAME_SIZE) == 0)
+        {
+            fprintf(stderr, "Frame %.16s is defined twice\n", frames[i].name);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < keyframeCount; i++)
+    {
+        if (findFrame(keyframes[i].frame) == -1)
+        {
+            fprintf(stderr, "Unknown frame %.16s in an animation\n", keyframes[i].frame);
+            return 1;
+        }
+    }
+
+    if (writePack(argv[2]) == -1)
+        return 1;
+
+    printf("%s: %d frames, %d animations, %d keyframes\n", argv[2], frameCount, animationCount, keyframeCount);
+    return 0;
+}
+
+// Reads every frame and animation in a description. Returns -1 on a syntax error.
+static int parse(FILE *file, const char *path)
+{
+    char line[MAX_LINE];
+    int lineNumber = 0;
+    Frame *frame = NULL;
+    int frameRow = 0;
+    Animation *animation = NULL;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (frame)
+        {
+            if (strlen(line) != 8 || strspn(line, "#.") != 8)
+            {
+                fprintf(stderr, "%s:%d: expected a row of 8 `#` or `.` pixels\n", path, lineNumber);
+                return -1;
+            }
+
+            unsigned char row = 0;
+            for (int i = 0; i < 8; i++)
+                row = (row << 1) | (line[i] == '#');
+            frame->rows[frameRow++] = row;
+
+            if (frameRow == 8)
+                frame = NULL;
+            continue;
+        }
+
+        char *word = strtok(line, " \t");
+        if (!word || word[0] == '#')
+            continue;
+
+        if (animation)
+        {
+            if (strcmp(word, "end") == 0)
+            {
+                if (animation->keyframeCount == 0)
+                {
+                    fprintf(stderr, "%s:%d: animation %.16s has no keyframes\n", path, lineNumber, animation->name);
+                    return -1;
+                }
+                animation = NULL;
+                continue;
+            }
+
+            char *transition = strtok(NULL, " \t");
+            char *transitionMs = strtok(NULL, " \t");
+            char *holdMs = strtok(NULL, " \t");
+            if (!holdMs)
+            {
+                fprintf(stderr, "%s:%d: expected <frame> <transition> <transition ms> <hold ms>\n", path, lineNumber);
+                return -1;
+            }
+
+            keyframes = grow(keyframes, keyframeCount, sizeof(Keyframe));
+            Keyframe *keyframe = &keyframes[keyframeCount++];
+            if (setName(keyframe->frame, word, lineNumber) == -1)
+                return -1;
+
+            keyframe->transition = -1;
+            for (int i = 0; i < TRANSITION_COUNT; i++)
+            {
+                if (strcmp(transition, TRANSITIONS[i]) == 0)
+                    keyframe->transition = i;
+            }
+
+            keyframe->transitionMs = atoi(transitionMs);
+            keyframe->holdMs = atoi(holdMs);
+            if (keyframe->transition == -1 || keyframe->transitionMs < 0 || keyframe->transitionMs > UINT16_MAX ||
+                keyframe->holdMs < 0 || keyframe->holdMs > UINT16_MAX)
+            {
+                fprintf(stderr, "%s:%d: bad transition or timing\n", path, lineNumber);
+                return -1;
+            }
+
+            animation->keyframeCount++;
+            continue;
+        }
+
+        char *name = strtok(NULL, " \t");
+        if (!name)
+        {
+            fprintf(stderr, "%s:%d: expected a name\n", path, lineNumber);
+            return -1;
+        }
+
+        if (strcmp(word, "frame") == 0)
+        {
+            frames = grow(frames, frameCount, sizeof(Frame));
+            frame = &frames[frameCount++];
+            frameRow = 0;
+            if (setName(frame->name, name, lineNumber) == -1)
+                return -1;
+        }
+        else if (strcmp(word, "animation") == 0)
+        {
+            animations = grow(animations, animationCount, sizeof(Animation));
+            animation = &animations[animationCount++];
+            if (setName(animation->name, name, lineNumber) == -1)
+                return -1;
+
+            char *loop = strtok(NULL, " \t");
+            animation->loop = loop && strcmp(loop, "loop") == 0;
+            animation->firstKeyframe = keyframeCount;
+            animation->keyframeCount = 0;
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: expected `frame` or `animation`\n", path, lineNumber);
+            return -1;
+        }
+    }
+
+    if (frame || animation)
+    {
+        fprintf(stderr, "%s: unexpected end of file\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Writes the pack to a temporary file, then renames it over `path`. Returns -1 on failure.
+static int writePack(const char *path)
+{
+    AssetHeader header = {0};
+    memcpy(header.magic, ASSET_MAGIC, 4);
+    header.version = ASSET_VERSION;
+    header.frameCount = frameCount;
+    header.animationCount = animationCount;
+    header.keyframeCount = keyframeCount;
+
+    // Every section size is a multiple of 4, so the sections stay aligned back to back.
+    header.framesOffset = sizeof(AssetHeader);
+    header.frameNamesOffset = header.framesOffset + frameCount * 8;
+    header.animationsOffset = header.frameNamesOffset + frameCount * sizeof(AssetFrameName);
+    header.keyframesOffset = header.animationsOffset + animationCount * sizeof(AssetAnimation);
+    header.fileSize = header.keyframesOffset + keyframeCount * sizeof(AssetKeyframe);
+    header.checksum = assetHeaderChecksum(&header);
+
+    char tmpPath[MAX_LINE];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    FILE *file = fopen(tmpPath, "wb");
+    if (!file)
+    {
+        perror(tmpPath);
+        return -1;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    for (int i = 0; i < frameCount; i++)
+        fwrite(frames[i].rows, 8, 1, file);
+
+    for (int i = 0; i < frameCount; i++)
+    {
+        AssetFrameName name = {0};
+        memcpy(name.name, frames[i].name, ASSET_NAME_SIZE);
+        name.frame = i;
+        fwrite(&name, sizeof(name), 1, file);
+    }
+
+    for (int i = 0; i < animationCount; i++)
+    {
+        AssetAnimation entry = {0};
+        memcpy(entry.name, animations[i].name, ASSET_NAME_SIZE);
+        entry.firstKeyframe = animations[i].firstKeyframe;
+        entry.keyframeCount = animations[i].keyframeCount;
+        entry.loop = animations[i].loop;
+        fwrite(&entry, sizeof(entry), 1, file);
+    }
+
+    for (int i = 0; i < keyframeCount; i++)
+    {
+        AssetKeyframe entry = {0};
+        entry.frame = findFrame(keyframes[i].frame);
+        entry.transition = keyframes[i].transition;
+        entry.transitionMs = keyframes[i].transitionMs;
+        entry.holdMs = keyframes[i].holdMs;
+        fwrite(&entry, sizeof(entry), 1, file);
+    }
+
+    if (fclose(file) != 0 || rename(tmpPath, path) == -1)
+    {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Copies a name into a NUL padded name field. Returns -1 if it does not fit.
+static int setName(char *name, const char *text, int line)
+{
+    if (strlen(text) > ASSET_NAME_SIZE)
+    {
+        fprintf(stderr, "line %d: name %s is longer than %d characters\n", line, text, ASSET_NAME_SIZE);
+        return -1;
+    }
+
+    memset(name, 0, ASSET_NAME_SIZE);
+    memcpy(name, text, strlen(text));
+    return 0;
+}
+
+// Makes room for one more item in a growing array, exiting if memory runs out.
+static void *grow(void *items, int count, size_t size)
+{
+    // Grow in powers of two.
+    if (count & (count - 1))
+        return items;
+
+    items = realloc(items, (count ? count * 2 : 1) * size);
+    if (!items)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    return items;
+}
+
+static int compareFrames(const void *a, const void *b)
+{
+    return strncmp(((const Frame *)a)->name, ((const Frame *)b)->name, ASSET_NAME_SIZE);
+}
+
+static int compareAnimations(const void *a, const void *b)
+{
+    return strncmp(((const Animation *)a)->name, ((const Animation *)b)->name, ASSET_NAME_SIZE);
+}
+
+// Returns the index of a frame after sorting, or -1 if there is none by that name.
+static int findFrame(const char *name)
+{
+    Frame key;
+    memcpy(key.name, name, ASSET_NAME_SIZE);
+    Frame *frame = bsearch(&key, frames, frameCount, sizeof(Frame), compareFrames);
+    return frame ? (int)(frame - frames) : -1;
+}
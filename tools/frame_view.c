@@ -0,0 +1,159 @@
+/*
+
+Follows the game's shared-memory frame ring (see src/frame_export_format.h) and prints every frame
+the matrix shows as ASCII, as it is shown.
+
+    gcc -O2 -Isrc tools/frame_view.c -o frame-view -lrt
+    FRAME_EXPORT= ./game &
+    ./frame-view [-1] [name]
+
+The ring is mapped read-only and frames are copied straight out of it, so any number of viewers can
+follow the game without slowing it down. `name` defaults to the game's, /memory-game-frames. With
+`-1`, only the latest frame is printed. Pixels are drawn by intensity, from ' ' (off) to '@' (full).
+
+If the viewer falls a whole ring behind, it skips ahead and says how many frames it missed. If the
+game restarts, the viewer follows the new ring.
+
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "frame_export_format.h"
+
+#define DEFAULT_NAME "/memory-game-frames"
+
+// How often the ring is checked for new frames, in microseconds.
+#define POLL_US 2000
+
+// A character per intensity level, from off to full.
+static const char INTENSITY_RAMP[] = " .,:;-~=+*oxO#%@";
+
+static const FrameExport *attach(const char *name);
+static void printFrame(const FrameExport *ring, uint64_t index, const FrameExportFrame *frame);
+
+int main(int argc, char **argv)
+{
+    const char *name = DEFAULT_NAME;
+    int once = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-1") == 0)
+            once = 1;
+        else if (argv[i][0] == '/')
+            name = argv[i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-1] [/name]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const FrameExport *ring = attach(name);
+    if (!ring)
+        return 1;
+
+    uint64_t head = atomic_load_explicit(&ring->header.head, memory_order_acquire);
+    uint64_t cursor = head > 0 ? head - 1 : 0;
+    FrameExportFrame frame;
+
+    while (1)
+    {
+        head = atomic_load_explicit(&ring->header.head, memory_order_acquire);
+
+        // The game restarted and began a new ring.
+        if (head < cursor)
+            cursor = 0;
+
+        if (head - cursor > FRAME_EXPORT_SLOTS)
+        {
+            printf("(skipped %llu frames)\n", (unsigned long long)(head - FRAME_EXPORT_SLOTS - cursor));
+            cursor = head - FRAME_EXPORT_SLOTS;
+        }
+
+        while (cursor < head)
+        {
+            int result = frameExportRead(ring, cursor, &frame);
+            if (result == 0)
+                break;
+
+            if (result == 1)
+                printFrame(ring, cursor, &frame);
+            else
+                printf("(frame %llu overwritten)\n", (unsigned long long)cursor);
+
+            cursor++;
+            if (once)
+                return 0;
+        }
+
+        fflush(stdout);
+        usleep(POLL_US);
+    }
+}
+
+// Maps the ring `name` read-only, and checks its header. Returns NULL if it is missing or not a ring.
+static const FrameExport *attach(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1)
+    {
+        perror(name);
+        return NULL;
+    }
+
+    const FrameExport *ring = mmap(NULL, sizeof(FrameExport), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED)
+    {
+        perror("Failed to map frame export");
+        return NULL;
+    }
+
+    // The magic is written last, so read it first: the fence then orders the rest of the header after it.
+    char magic[sizeof(ring->header.magic)];
+    memcpy(magic, ring->header.magic, sizeof(magic));
+    atomic_thread_fence(memory_order_acquire);
+    if (memcmp(magic, FRAME_EXPORT_MAGIC, sizeof(magic)) != 0 ||
+        ring->header.version != FRAME_EXPORT_VERSION || ring->header.slotCount != FRAME_EXPORT_SLOTS ||
+        ring->header.panelsWide * ring->header.panelsHigh > FRAME_EXPORT_MAX_PANELS)
+    {
+        fprintf(stderr, "%s is not a version %d frame ring\n", name, FRAME_EXPORT_VERSION);
+        munmap((void *)ring, sizeof(FrameExport));
+        return NULL;
+    }
+
+    return ring;
+}
+
+// Prints a frame as rows of characters, one per pixel, across every panel.
+static void printFrame(const FrameExport *ring, uint64_t index, const FrameExportFrame *frame)
+{
+    int wide = ring->header.panelsWide;
+    int high = ring->header.panelsHigh;
+
+    printf("frame %llu  t=%llu.%03llums  generation %llu\n", (unsigned long long)index,
+           (unsigned long long)(frame->timeNs / 1000000), (unsigned long long)(frame->timeNs / 1000 % 1000),
+           (unsigned long long)frame->generation);
+
+    for (int y = 0; y < high * 8; y++)
+    {
+        char line[FRAME_EXPORT_MAX_PANELS * 8 + 1];
+        for (int x = 0; x < wide * 8; x++)
+        {
+            const unsigned char *panel = frame->panels[(y / 8) * wide + x / 8];
+            int level = 0;
+            for (int b = 0; b < FRAME_EXPORT_BITS; b++)
+                level |= ((panel[b * 8 + y % 8] >> (7 - x % 8)) & 1) << b;
+
+            line[x] = INTENSITY_RAMP[level];
+        }
+
+        line[wide * 8] = '\0';
+        printf("|%s|\n", line);
+    }
+}